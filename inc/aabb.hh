@@ -33,6 +33,9 @@ namespace RS
         /// Checks whether v is in the AABB
         bool isInside(const Vec3r &v) const;
         // ------------------------------------------------------------------------- //
+        const Vec3r &getMin() const { return v_min; }
+        const Vec3r &getMax() const { return v_max; }
+        // ------------------------------------------------------------------------- //
         /// Returns an optional 2D vector which contains the ray positions
         /// of the entering and the exiting positions. If there is no intersection
         /// then the optional does not contain an object.
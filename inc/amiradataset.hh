@@ -1,8 +1,9 @@
 #pragma once
+#include <cstdint>
+#include <memory>
+
 #include "flow.hh"
-#include "vclibs/mvfields/grid_d2.hh"
-#include "vclibs/mvfields/grid_d3.hh"
-#include "vclibs/mvfields/grid_d4.hh"
+#include "slicestream.hh"
 
 //--------------------------------------------------------------------------//
 namespace RS
@@ -15,6 +16,17 @@ namespace RS
         AmiraDataSet(const std::string &filename);
         AmiraDataSet(const std::vector<std::string> &filenames,
                      const Vec2r &timeInfo);
+        /// Uses the binary cache file, which holds the whole time series as float32
+        /// grid. If the file does not exist (or does not match), the AmiraMesh files
+        /// are loaded once and converted into it. The cache file is mapped read-only
+        /// into memory, so that several processes can share it.
+        /// If maxResidentSlices > 0, the time slices are streamed from the cache
+        /// file instead: only this number of slices is kept in memory and the
+        /// following slices are prefetched in the background.
+        AmiraDataSet(const std::vector<std::string> &filenames,
+                     const Vec2r &timeInfo,
+                     const std::string &cacheFile,
+                     size_t maxResidentSlices = 0);
         AmiraDataSet(const AmiraDataSet &other);
         AmiraDataSet &operator=(const AmiraDataSet &other);
         //--------------------------------------------------------------------------//
@@ -23,6 +35,24 @@ namespace RS
         /// compute flow
         virtual Vec3r v(real t, const Vec3r &pos) const override;
         //--------------------------------------------------------------------------//
+        /// compute flow for n samples at once: on the float32 grid, the nodes of
+        /// the cells are gathered from the component arrays for 16 samples at a
+        /// time; streamed and double precision grids are interpolated one by one
+        virtual void v_batch(const real *t, const Vec3r *pos, Vec3r *out, size_t n) const override;
+        //--------------------------------------------------------------------------//
+        /// compute the spatial gradient of the flow by central differences over one
+        /// grid cell (the interpolation is only piecewise linear, so smaller steps
+        /// would just return the gradient of the current cell)
+        virtual Gradient jacobian(real t, const Vec3r &pos) const override;
+        //--------------------------------------------------------------------------//
+        /// Converts the loaded grid into float32 storage (x, y and z arrays per time
+        /// slice), which halves the memory footprint and bandwidth of the grid. If
+        /// validate is set, both storages are compared on numSamples random points
+        /// of the domain before the double precision grid is released; the max
+        /// deviation is printed and returned. Data sets which use a cache file are
+        /// float32 already.
+        real useFloatStorage(bool validate = false, size_t numSamples = 100000);
+        //--------------------------------------------------------------------------//
     protected:
         //--------------------------------------------------------------------------//
         virtual void init(const real *bbox) override;
@@ -41,6 +71,9 @@ namespace RS
         //--------------------------------------------------------------------------//
         // members to handle the loaded data
         std::vector<std::string> m_filenames; // comes as input
+        real m_timeRange[2] = {0.0, 0.0};     // comes as input
+        std::string m_cacheFile;              // binary cache file (optional)
+        size_t m_maxResidentSlices = 0;       // if > 0, slices are streamed from the cache file
         //--------------------------------------------------------------------------//
         int m_dimX = 0;
         int m_dimY = 0;
@@ -49,12 +82,62 @@ namespace RS
         int m_components = 0;
         Vec3r *mp_gridData = nullptr;
         //--------------------------------------------------------------------------//
-        typedef VC::mvfields::d4::grid<real, Vec3r> Vec4rGrid;
-        typedef VC::mvfields::d4::kernel::linear_interpolatory_c0<Vec4rGrid>
-            Vec4rKernel;
-        typedef VC::mvfields::d4::evaluator<Vec4rKernel> Vec4rField;
+        // float32 grid (mapped cache file or m_floatGrid): for each time slice the x, y and z
+        // components are stored after each other (structure of arrays)
+        const float *mp_floatData = nullptr;
+        size_t m_componentStride = 0; // number of floats per component array
+        size_t m_sliceStride = 0;     // number of floats per time slice
+        void *mp_mapping = nullptr;
+        size_t m_mappingSize = 0;
+        std::unique_ptr<SliceStream> mp_sliceStream; // replaces the mapping in streaming mode
+        std::vector<float> m_floatGrid;              // owned float32 grid (see useFloatStorage)
+        //--------------------------------------------------------------------------//
+        // origin and inverse spacing of the uniform xyzt-grid
+        real m_gridOrigin[4] = {0.0, 0.0, 0.0, 0.0};
+        real m_gridInvSpacing[4] = {0.0, 0.0, 0.0, 0.0};
+        //--------------------------------------------------------------------------//
+        /// Quadrilinear interpolation of the grid data at (pos, t). The time must
+        /// already be adapted for steady and periodic flows. Positions outside of
+        /// the grid are clamped to its boundary.
+        Vec3r interpolate(real t, const Vec3r &pos) const;
+        /// Adapts the time for steady and periodic flows.
+        real prepareTime(real t) const;
+        /// Computes origin and spacing of the grid from the bounding box.
+        void setupGrid(void);
+        //--------------------------------------------------------------------------//
+        // binary cache file
+        struct CacheHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t num_files;      // number of converted AmiraMesh files
+            double time_range[2];    // time range given for the files
+            uint64_t fingerprint;    // of the names, sizes and modification times of the files
+            int32_t dims[4];         // xyzt-dimensions of the grid
+            double bbox[8];          // xyzt-bounding box of the grid
+            uint64_t component_stride;
+            uint64_t slice_stride;
+            uint64_t data_offset;    // position of the first float in the file
+        };
+        static constexpr const char *CACHE_MAGIC = "RSAMIRA";
+        static constexpr uint32_t CACHE_VERSION = 2;
+        static constexpr int PREFETCH_SLICES = 2; // slices loaded ahead in streaming mode
         //--------------------------------------------------------------------------//
-        Vec4rGrid m_vec4Grid; // Contains sampled vector grids, sorted to by tau value
+        CacheHeader createCacheHeader(void) const;
+        bool isValidCacheHeader(const CacheHeader &header) const;
+        /// Hashes name, size and modification time of each AmiraMesh file, so that a
+        /// cache file is not used anymore after the files were replaced.
+        uint64_t fingerprintFiles(void) const;
+        /// Reads the header of the cache file. Fails if it does not match the files.
+        bool readCacheHeader(CacheHeader *p_header) const;
+        void applyCacheHeader(const CacheHeader &header);
+        /// Converts the AmiraMesh files one by one into the cache file.
+        bool convertToCache(void);
+        /// Maps the whole cache file into memory.
+        bool mapCache(const CacheHeader &header);
+        void unmapCache(void);
+        /// Returns the float32 data of two time slices (mapped or streamed).
+        void getFloatSlices(int slice, int next, const float **p_slice, const float **p_next) const;
         //--------------------------------------------------------------------------//
     };
     //--------------------------------------------------------------------------//
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "flowsampler.hh"
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+  //--------------------------------------------------------------------------//
+  /// Integrates many seeds at once. The states of up to WIDTH particles are
+  /// stored as structure of arrays and advanced in lockstep by the embedded
+  /// Runge-Kutta 4(3) scheme of Kutta-Merson, so the arithmetic of all lanes is
+  /// vectorized. Each lane has its own adaptive step size. Lanes which reached
+  /// their end time or the boundary of the domain are masked out.
+  /// This is not the RK43 pair of FlowSampler3D: a step is accepted if the
+  /// difference of the 4th and 3rd order solution is within abstol + reltol * |y|
+  /// in each component, so the pathlines only agree with the scalar ones within
+  /// the tolerances. FlowMapCache integrates all flow maps with this sampler, so
+  /// cached flow maps never mix the two schemes.
+  class BatchFlowSampler3D
+  {
+  public:
+    //--------------------------------------------------------------------------//
+    /// Number of lanes which are integrated in lockstep (one AVX-512 register).
+    static constexpr size_t WIDTH = 8;
+    //--------------------------------------------------------------------------//
+    struct Options
+    {
+      real hmax = 0.01;         // maximal step size (same as FlowSampler)
+      real rsmin = 0.00000005;  // minimal step size relative to tau
+      real abstol = 0.000001;   // absolute error tolerance per step
+      real reltol = 0.000001;   // relative error tolerance per step
+    };
+    //--------------------------------------------------------------------------//
+    BatchFlowSampler3D(const Flow<Vec3r, 3> &flow);
+    //--------------------------------------------------------------------------//
+    const Flow<Vec3r, 3> &getFlow(void) const { return m_flow; }
+    //--------------------------------------------------------------------------//
+    /// Integrates the seeds (p_positions[i], p_t0[i]) for the time p_tau[i] and
+    /// stores the dense pathline in p_sols[i]. The seeds are processed in batches of
+    /// WIDTH. If p_states is given, the final state of each lane is written to
+    /// it. A lane which leaves the domain stops with HitBoundary. A lane for which
+    /// the flow throws ForceStop stops at its last accepted position with
+    /// ForceStop, like the scalar Evaluator.
+    /// If p_stepSizes is given, non-zero entries are used as initial step sizes
+    /// (e.g. to resume an integration) and the step sizes which would be used
+    /// next are written to it.
+    void sampleFlows(size_t count,
+                     const Vec3r *p_positions,
+                     const real *p_t0,
+                     const real *p_tau,
+                     Pathline3D *const *p_sols,
+                     VC::math::ode::EvalState *p_states = nullptr,
+                     int maxSteps = 0,
+                     real *p_stepSizes = nullptr);
+    //--------------------------------------------------------------------------//
+    Options options;
+    //--------------------------------------------------------------------------//
+  private:
+    //--------------------------------------------------------------------------//
+    /// Structure of arrays holding one vector per lane.
+    struct alignas(64) Lanes
+    {
+      real x[WIDTH];
+      real y[WIDTH];
+      real z[WIDTH];
+    };
+    //--------------------------------------------------------------------------//
+    /// Integrates at most WIDTH seeds in lockstep.
+    void sampleBatch(size_t count,
+                     const Vec3r *p_positions,
+                     const real *p_t0,
+                     const real *p_tau,
+                     Pathline3D *const *p_sols,
+                     VC::math::ode::EvalState *p_states,
+                     int maxSteps,
+                     real *p_stepSizes);
+    //--------------------------------------------------------------------------//
+    /// Evaluates the velocity at (t[i], pos[i]) for all lanes with active[i].
+    /// Lanes whose position is not inside the domain are flagged in outside,
+    /// lanes for which the flow requests a ForceStop are flagged in stopped.
+    void evalVelocity(const real *t,
+                      const Lanes &pos,
+                      const bool *active,
+                      Lanes *p_vel,
+                      bool *outside,
+                      bool *stopped) const;
+    //--------------------------------------------------------------------------//
+    const Flow<Vec3r, 3> &m_flow;
+    //--------------------------------------------------------------------------//
+  };
+  //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
@@ -6,6 +6,12 @@
 //--------------------------------------------------------------------------//
 namespace RS
 {
+  //--------------------------------------------------------------------------//
+  enum class CamUp
+  {
+    Y,
+    Z
+  };
   //--------------------------------------------------------------------------//
   /// \brief Interface for camera implementations.
   ///
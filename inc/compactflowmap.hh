@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+
+#include "globals.hh"
+#include "types.hh"
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+  //--------------------------------------------------------------------------//
+  /// Compact representation of a flow map. A dense pathline stores every
+  /// accepted integration step, although the flow map is only queried for the
+  /// positions at a few times. The compact flow map keeps only those steps,
+  /// which are needed to reproduce the dropped ones by cubic Hermite
+  /// interpolation within a given tolerance. Optionally, positions and
+  /// derivatives are stored as float (the times are always kept as real).
+  /// If the integration was not stopped early, the flow map can be extended to
+  /// a larger integration time later on by resuming at its end.
+  class CompactFlowMap3D
+  {
+  public:
+    //--------------------------------------------------------------------------//
+    CompactFlowMap3D(void);
+    //--------------------------------------------------------------------------//
+    /// Compresses the given pathline. Each dropped step and the midpoint of each
+    /// dense step are reproduced with a maximum (component-wise) deviation of
+    /// tolerance; in between, the deviation is not checked. With float storage
+    /// the rounding error of float is added to this bound.
+    CompactFlowMap3D(const Pathline3D &pathline,
+                     real tolerance = Globals::FLOWMAP_COMPACT_TOLERANCE,
+                     bool use_float = Globals::FLOWMAP_FLOAT_STORAGE);
+    //--------------------------------------------------------------------------//
+    bool empty(void) const { return m_t.empty(); }
+    /// Returns the number of stored nodes.
+    size_t size(void) const { return m_t.size(); }
+    //--------------------------------------------------------------------------//
+    /// Returns the start time t0 of the flow map.
+    real startTime(void) const { return m_t.front(); }
+    /// Returns the time which was reached by the integration.
+    real endTime(void) const { return m_t.back(); }
+    //--------------------------------------------------------------------------//
+    /// Returns the position of the particle at time t. Times outside of the
+    /// integrated range are clamped to it. The flow map must not be empty.
+    Vec3r eval_position_at(real t) const;
+    //--------------------------------------------------------------------------//
+    /// Stores how the integration of the pathline ended. Only if the integration
+    /// reached its end time (Success), the flow map can be extended.
+    void setIntegrationState(VC::math::ode::EvalState state);
+    //--------------------------------------------------------------------------//
+    /// Returns true if the positions up to startTime() + tau are available.
+    bool reaches(real tau) const;
+    /// Returns true if the flow map reaches tau or its integration was stopped
+    /// (e.g. because the particle left the domain), so it can not get longer.
+    bool covers(real tau) const { return reaches(tau) || isStopped(); }
+    /// Returns true if the integration ended before its end time. A flow map
+    /// which was never integrated is not stopped.
+    bool isStopped(void) const { return m_isStopped; }
+    /// Returns true if the integration can be resumed at the end of the flow map.
+    bool isExtendable(void) const { return !empty() && !m_isStopped; }
+    /// Returns the integration time which is covered by the flow map (infinity
+    /// if it was stopped).
+    real reach(void) const;
+    //--------------------------------------------------------------------------//
+    /// Returns the exact position of the particle at endTime().
+    const Vec3r &endPosition(void) const { return m_endPos; }
+    //--------------------------------------------------------------------------//
+    /// Returns a copy of this flow map, which is extended by the given pathline.
+    /// The pathline must start at endTime() and endPosition().
+    CompactFlowMap3D extended(const Pathline3D &pathline,
+                              VC::math::ode::EvalState state) const;
+    //--------------------------------------------------------------------------//
+    /// Returns the number of bytes occupied by the flow map.
+    size_t getMemoryUsage(void) const;
+    //--------------------------------------------------------------------------//
+  private:
+    //--------------------------------------------------------------------------//
+    /// Returns component c of the node (c < 3: position, else derivative).
+    real value(size_t node, int c) const
+    {
+      return m_isFloat ? real(m_dataf[6 * node + c]) : m_data[6 * node + c];
+    }
+    //--------------------------------------------------------------------------//
+    /// Hermite interpolation between two nodes given by time, position and
+    /// derivative.
+    static Vec3r hermite(real t,
+                         real t_a,
+                         const Vec3r &y_a,
+                         const Vec3r &dy_a,
+                         real t_b,
+                         const Vec3r &y_b,
+                         const Vec3r &dy_b);
+    //--------------------------------------------------------------------------//
+    std::vector<real> m_t;      // times of the nodes
+    std::vector<real> m_data;   // position and derivative per node (real storage)
+    std::vector<float> m_dataf; // position and derivative per node (float storage)
+    bool m_isFloat = false;
+    bool m_isBackward = false;  // true for negative integration time
+    bool m_isStopped = false;   // the integration ended early and can not be resumed
+    Vec3r m_endPos;             // exact position at the last node (for resuming)
+    //--------------------------------------------------------------------------//
+  };
+  //--------------------------------------------------------------------------//
+  typedef CompactFlowMap3D FlowMap3D;
+  //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
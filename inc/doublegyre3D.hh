@@ -22,6 +22,12 @@ namespace RS
     /// compute flow
     virtual Vec3r v(real t, const Vec3r &pos) const override;
     //--------------------------------------------------------------------------//
+    /// compute flow for n samples at once (vectorized)
+    virtual void v_batch(const real *t, const Vec3r *pos, Vec3r *out, size_t n) const override;
+    //--------------------------------------------------------------------------//
+    /// compute the spatial gradient of the flow (analytic)
+    virtual Gradient jacobian(real t, const Vec3r &pos) const override;
+    //--------------------------------------------------------------------------//
     /**Parameters must be stored in the order: A, omega, eps.*/
     bool setParameters(const real *p_params) override;
     void setParameters(const real &A, const real &omega, const real &eps);
@@ -62,6 +68,21 @@ namespace RS
       return v;
     }
     //--------------------------------------------------------------------------//
+    /// the vectorized version of DoubleGyre3D does not know about the 2D case
+    virtual void v_batch(const real *t, const Vec3r *pos, Vec3r *out, size_t n) const override
+    {
+      Flow3D::v_batch(t, pos, out, n);
+    }
+    //--------------------------------------------------------------------------//
+    virtual Gradient jacobian(real t, const Vec3r &pos) const override
+    {
+      Vec3r pos_2d(pos[0], pos[1], 0.0);
+      Gradient gradient = DoubleGyre3D::jacobian(t, pos_2d);
+      gradient.row(2).setZero();
+      gradient.col(2).setZero();
+      return gradient;
+    }
+    //--------------------------------------------------------------------------//
   };
   //--------------------------------------------------------------------------//
 }
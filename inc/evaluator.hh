@@ -63,6 +63,97 @@ namespace RS
     //--------------------------------------------------------------------------//
   };
   //--------------------------------------------------------------------------//
+  /// Integrates a pathline together with its variational equations
+  /// dG/dt = J(t, x(t)) * G, G(t0) = I, where J is the spatial gradient of the
+  /// flow. G is the gradient of the flow map with respect to the seed position.
+  /// The state stores the position followed by G in column-major order.
+  template <typename T, unsigned int n>
+  class VariationalEvaluator
+      : public VC::math::ode::base_evaluator<real, VC::math::VecN<real, n + n * n>>
+  {
+  public:
+    //--------------------------------------------------------------------------//
+    typedef VC::math::VecN<real, n + n * n> State;
+    typedef typename Flow<T, n>::Gradient Gradient;
+    //--------------------------------------------------------------------------//
+    VariationalEvaluator<T, n>(const Flow<T, n> *p_flow)
+        : mp_flow(p_flow), m_forcedStop(false) {}
+    //--------------------------------------------------------------------------//
+    virtual ~VariationalEvaluator(){};
+    //--------------------------------------------------------------------------//
+    static State pack(const T &pos, const Gradient &gradient)
+    {
+      State state;
+      for (unsigned int i = 0; i < n; ++i)
+        state[i] = pos[i];
+      for (unsigned int j = 0; j < n; ++j)
+        for (unsigned int i = 0; i < n; ++i)
+          state[n + j * n + i] = gradient(i, j);
+      return state;
+    }
+    //--------------------------------------------------------------------------//
+    static T position(const State &state)
+    {
+      T pos;
+      for (unsigned int i = 0; i < n; ++i)
+        pos[i] = state[i];
+      return pos;
+    }
+    //--------------------------------------------------------------------------//
+    static Gradient gradient(const State &state)
+    {
+      Gradient gradient;
+      for (unsigned int j = 0; j < n; ++j)
+        for (unsigned int i = 0; i < n; ++i)
+          gradient(i, j) = state[n + j * n + i];
+      return gradient;
+    }
+    //--------------------------------------------------------------------------//
+    // Hide parent method
+    void dy(const real &t, const State &state, State &dy)
+    {
+      T pos = position(state);
+      mp_flow->ensureIsInside(pos);
+      try
+      {
+        dy = pack(mp_flow->v(t, pos), mp_flow->jacobian(t, pos) * gradient(state));
+      }
+      catch (VC::math::ode::EvalState &evalState)
+      {
+        if (evalState == VC::math::ode::EvalState::ForceStop)
+          m_forcedStop = true;
+        else
+          throw evalState;
+      }
+    }
+    //--------------------------------------------------------------------------//
+    // Hide parent method
+    void output(real t, const State &state, const State &dy)
+    {
+      utils::unusedArgs(t, dy);
+      mp_flow->ensureIsInside(position(state));
+      if (m_forcedStop)
+      {
+        m_forcedStop = false;
+        throw VC::math::ode::EvalState::ForceStop;
+      }
+    }
+    //--------------------------------------------------------------------------//
+    virtual void initialize(real t,
+                            const State &state,
+                            VC::math::ode::RK43<VariationalEvaluator> *rk)
+    {
+      utils::unusedArgs(t, rk);
+      mp_flow->ensureIsInside(position(state));
+    }
+    //--------------------------------------------------------------------------//
+  protected:
+    //--------------------------------------------------------------------------//
+    const Flow<T, n> *mp_flow;
+    bool m_forcedStop;
+    //--------------------------------------------------------------------------//
+  };
+  //--------------------------------------------------------------------------//
   typedef Evaluator<Vec2r, 2> Evaluator2D;
   typedef Evaluator<Vec3r, 3> Evaluator3D;
   //--------------------------------------------------------------------------//
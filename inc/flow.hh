@@ -5,6 +5,9 @@
 // #include "vclibs/base/log.hh"
 // #include "vclibs/base/printf.hh"
 
+#include <algorithm>
+#include <atomic>
+
 #include "math.hh"
 #include "types.hh"
 //#include "vclibs/math/Mat2x2.hh"
@@ -15,6 +18,13 @@
 //--------------------------------------------------------------------------//
 namespace RS
 {
+  //--------------------------------------------------------------------------//
+  /// Returns a new process-wide unique identifier for a flow.
+  inline size_t createFlowId(void)
+  {
+    static std::atomic<size_t> next_id{0};
+    return ++next_id;
+  }
   //--------------------------------------------------------------------------//
   template <typename T, unsigned int n>
   class Flow
@@ -22,7 +32,7 @@ namespace RS
   public:
     //--------------------------------------------------------------------------//
     Flow<T, n>(const real *domain, const std::string &name = "Flow")
-        : m_name(name), m_dimension(n)
+        : m_name(name), m_dimension(n), m_id(createFlowId())
     {
       init(domain);
     }
@@ -41,6 +51,39 @@ namespace RS
     /// compute flow
     virtual T v(real t, const T &pos) const = 0;
     //--------------------------------------------------------------------------//
+    /// compute flow for count samples at once: out[i] = v(t[i], pos[i])
+    /// Flows which can vectorize their evaluation override this default loop.
+    virtual void v_batch(const real *t, const T *pos, T *out, size_t count) const
+    {
+      for (size_t i = 0; i < count; ++i)
+        out[i] = v(t[i], pos[i]);
+    }
+    //--------------------------------------------------------------------------//
+    /// Gradient of the flow in space, (J)_ij = dv_i / dx_j.
+    typedef Eigen::Matrix<real, n, n> Gradient;
+    //--------------------------------------------------------------------------//
+    /// compute the spatial gradient of the flow
+    /// The default uses central differences with step Globals::JACOBIAN_FDSTEP
+    /// (one-sided at the border of the domain). Flows which know their gradient
+    /// analytically or which are sampled on a grid override it.
+    virtual Gradient jacobian(real t, const T &pos) const
+    {
+      Gradient gradient;
+      const real h = Globals::JACOBIAN_FDSTEP;
+      for (unsigned int j = 0; j < n; ++j)
+      {
+        T pos_a = pos;
+        T pos_b = pos;
+        pos_a[j] = std::max(pos[j] - h, mp_domain[2 * j]);
+        pos_b[j] = std::min(pos[j] + h, mp_domain[2 * j + 1]);
+        real dist = pos_b[j] - pos_a[j];
+        T diff = dist > 0.0 ? (v(t, pos_b) - v(t, pos_a)) / dist : T(0.0);
+        for (unsigned int i = 0; i < n; ++i)
+          gradient(i, j) = diff[i];
+      }
+      return gradient;
+    }
+    //--------------------------------------------------------------------------//
     /// Check if pos is inside the defined domain (spatial part of bounding box)
     virtual bool isInside(const T &pos) const
     {
@@ -52,6 +95,10 @@ namespace RS
     //--------------------------------------------------------------------------//
     const std::string &getName(void) const { return m_name; }
     //--------------------------------------------------------------------------//
+    /** Unique identifier of the flow. It changes whenever the flow is modified,
+     * so it can be used to identify cached results which depend on the flow. */
+    size_t getId(void) const { return m_id; }
+    //--------------------------------------------------------------------------//
     /** Unified method to set parameters indepentend from the
      * flow itself. The caller has to make sure the correct number
      * of parameters is stored in the array, which is given as parameter.
@@ -60,18 +107,31 @@ namespace RS
     virtual bool setParameters(const real *) { return true; }
     //--------------------------------------------------------------------------//
     bool isPeriodic(void) const { return m_periodic; }
-    void setPeriodic(bool periodic) { m_periodic = periodic; }
+    void setPeriodic(bool periodic)
+    {
+      m_periodic = periodic;
+      renewId();
+    }
     //--------------------------------------------------------------------------//
     bool isInverted(void) const { return m_inverted; }
-    void setInverted(bool inverted) { m_inverted = inverted; }
+    void setInverted(bool inverted)
+    {
+      m_inverted = inverted;
+      renewId();
+    }
     //--------------------------------------------------------------------------//
     bool isSteady(void) const { return m_steady; }
     void setSteady(real t)
     {
       m_steady = true;
       m_steady_time = t;
+      renewId();
+    }
+    void setUnsteady(void)
+    {
+      m_steady = false;
+      renewId();
     }
-    void setUnsteady(void) { m_steady = false; }
     //--------------------------------------------------------------------------//
   protected:
     //--------------------------------------------------------------------------//
@@ -85,6 +145,9 @@ namespace RS
         mp_domain[i] = bbox[i];
     }
     //--------------------------------------------------------------------------//
+    /** Has to be called by every method which changes the values of the flow. */
+    void renewId(void) { m_id = createFlowId(); }
+    //--------------------------------------------------------------------------//
     /** Make the time periodic. The last component of the domain specifies the dimension in time. */
     real clampTime(const real &t0) const
     {
@@ -104,6 +167,7 @@ namespace RS
     std::string m_name;
     real *mp_domain = nullptr;
     unsigned int m_dimension;
+    size_t m_id;
     bool m_periodic = false; // if true, the time component is clamped
     bool m_inverted = false; // if true, the velocity is inverted
     bool m_steady = false;
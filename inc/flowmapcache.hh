@@ -0,0 +1,174 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <omp.h>
+#include <unordered_map>
+
+#include "batchflowsampler.hh"
+#include "flowsampler.hh"
+#include "globals.hh"
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+  //--------------------------------------------------------------------------//
+  /// Process-wide cache for flow maps, which is shared by all HyperLines and rays.
+  /// A flow map is identified by the id of its flow, the quantized start
+  /// position and start time and the direction of the integration. Flow maps are
+  /// integrated in chunks of Globals::FLOWMAP_CHUNK_TAU, as many as needed for
+  /// the requested integration time. If a larger integration time is requested
+  /// later on, the next chunks are appended and the extended copy replaces the
+  /// cached flow map. Each chunk ends at a multiple of the chunk length and starts
+  /// with a fresh step size, so a flow map does not depend on the order of the
+  /// requests. All flow maps are integrated by BatchFlowSampler3D (a single
+  /// request is a batch of one), so cached flow maps never mix its scheme with
+  /// the RK43 of FlowSampler3D. The cache is split into shards which are locked
+  /// independently, so threads rarely have to wait for each other. If the memory budget (Globals::FLOWMAP_CACHE_MAXBYTES) is exceeded,
+  /// the least recently used flow maps are evicted. Evicted flow maps stay valid
+  /// as long as they are referenced somewhere else.
+  /// While a TileScope is alive, the thread additionally keeps its own map of
+  /// all flow maps it used. It is consulted before the shards, so neighbouring
+  /// rays of one image tile reuse flow maps without taking any lock.
+  class FlowMapCache
+  {
+  public:
+    //--------------------------------------------------------------------------//
+    /// Identifies a flow map by its flow, the quantized values x, y, z, t0 and the
+    /// sign of tau.
+    struct Key
+    {
+      size_t flow_id;
+      std::array<long long, 5> values;
+      bool operator==(const Key &other) const
+      {
+        return flow_id == other.flow_id && values == other.values;
+      }
+    };
+    //--------------------------------------------------------------------------//
+    struct KeyHash
+    {
+      size_t operator()(const Key &key) const;
+    };
+    //--------------------------------------------------------------------------//
+    typedef std::unordered_map<Key, std::shared_ptr<FlowMap3D>, KeyHash> LocalMap;
+    //--------------------------------------------------------------------------//
+    /// Activates the thread local flow map layer for the lifetime of the object
+    /// (e.g. while a thread works on one image tile). Scopes must not be nested.
+    /// The local map holds references to its flow maps, so they are not freed
+    /// by an eviction of the shared cache before the scope ends.
+    class TileScope
+    {
+    public:
+      TileScope();
+      ~TileScope();
+      TileScope(const TileScope &) = delete;
+      TileScope &operator=(const TileScope &) = delete;
+
+    private:
+      friend class FlowMapCache;
+      LocalMap m_flowMaps;
+      size_t m_bytes = 0; // estimated memory of the referenced flow maps
+      size_t m_hits = 0;  // added to the shared counter at the end of the scope
+      //--------------------------------------------------------------------------//
+      /// Adds a flow map. If Globals::FLOWMAP_TILECACHE_MAXBYTES is exceeded, the
+      /// map is emptied first (the flow maps are still in the shared cache).
+      void add(const Key &key, const std::shared_ptr<FlowMap3D> &flow_map);
+    };
+    //--------------------------------------------------------------------------//
+  private:
+    //--------------------------------------------------------------------------//
+    struct Entry
+    {
+      std::shared_ptr<FlowMap3D> flow_map;
+      size_t bytes;
+      std::list<Key>::iterator lru_pos;
+    };
+    //--------------------------------------------------------------------------//
+    struct Shard
+    {
+      omp_lock_t lck;
+      std::unordered_map<Key, Entry, KeyHash> entries;
+      std::list<Key> lru; // most recently used flow map is in front
+      size_t bytes = 0;
+    };
+    //--------------------------------------------------------------------------//
+    static constexpr size_t NUM_SHARDS = 64;
+    Shard m_shards[NUM_SHARDS];
+    std::atomic<size_t> m_hits;
+    std::atomic<size_t> m_misses;
+    //--------------------------------------------------------------------------//
+    static FlowMapCache _instance;
+    static thread_local TileScope *tp_tileScope; // active scope of the thread
+    //--------------------------------------------------------------------------//
+    FlowMapCache();
+    ~FlowMapCache();
+    //--------------------------------------------------------------------------//
+    Shard &getShard(const Key &key);
+    //--------------------------------------------------------------------------//
+    /// Removes least recently used entries until the shard fits into its budget.
+    /// The lock of the shard must be held by the caller.
+    void evict(Shard &shard, size_t budget);
+    //--------------------------------------------------------------------------//
+  public:
+    //--------------------------------------------------------------------------//
+    FlowMapCache(const FlowMapCache &) = delete;
+    FlowMapCache &operator=(const FlowMapCache &) = delete;
+    //--------------------------------------------------------------------------//
+    /// Returns the instance of the cache.
+    static FlowMapCache &instance() { return _instance; }
+    //--------------------------------------------------------------------------//
+    /// Creates the key for a flow map by quantizing the seed values with
+    /// Globals::FLOWMAP_CACHE_QUANTUM.
+    static Key createKey(size_t flow_id, const Vec3r &pos, real t0, real tau);
+    //--------------------------------------------------------------------------//
+    /// Returns the integration time |tau| at which the chunk following the
+    /// integration time reached ends.
+    static real getChunkEnd(real reached);
+    //--------------------------------------------------------------------------//
+    /// Estimates the number of bytes which are occupied by a flow map.
+    static size_t estimateBytes(const FlowMap3D &flow_map);
+    //--------------------------------------------------------------------------//
+    /// Returns the cached flow map or nullptr if it is not available. The local
+    /// map of the thread is checked before the shared shards. The returned flow
+    /// map might not cover tau (see CompactFlowMap3D::covers), in this case it
+    /// has to be extended.
+    std::shared_ptr<FlowMap3D> find(const Key &key, real tau = 0.0);
+    //--------------------------------------------------------------------------//
+    /// Inserts a flow map. If there is already a flow map with the same key, the
+    /// one which reaches further is kept and returned. The result is also added
+    /// to the local map of the thread.
+    std::shared_ptr<FlowMap3D> insert(const Key &key, const std::shared_ptr<FlowMap3D> &flow_map);
+    //--------------------------------------------------------------------------//
+    /// Returns a flow map for the given seed which covers at least tau. It is
+    /// only integrated (and compressed) as far as it is not cached yet, like in
+    /// getFlowMaps.
+    std::shared_ptr<FlowMap3D> getFlowMap(const Flow<Vec3r, 3> &flow,
+                                          const Vec3r &pos,
+                                          real t0,
+                                          real tau);
+    //--------------------------------------------------------------------------//
+    /// Batched version of getFlowMap. All flow maps which are not cached yet or
+    /// need to be extended are integrated together by the batch sampler.
+    void getFlowMaps(BatchFlowSampler3D &sampler,
+                     size_t count,
+                     const Vec3r *p_positions,
+                     const real *p_t0,
+                     const real *p_tau,
+                     std::shared_ptr<FlowMap3D> *p_flowMaps);
+    //--------------------------------------------------------------------------//
+    /// Removes all flow maps from the cache.
+    void clear();
+    //--------------------------------------------------------------------------//
+    /// Returns the estimated number of bytes which are occupied by the cache.
+    size_t getMemoryUsage();
+    //--------------------------------------------------------------------------//
+    /// Prints hit rate and memory usage to the console and resets the counters.
+    void printStats();
+    //--------------------------------------------------------------------------//
+  };
+  //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "aabb.hh"
+#include "jobparams.hh"
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+    // ------------------------------------------------------------------------- //
+    /// Flow maps phi(x, t0, tau) precomputed on a regular spatial lattice over the
+    /// domain for all t0 and tau nodes of the search. The end positions are stored
+    /// as float in a file, which is mapped into memory. Queries interpolate them
+    /// (trilinear in space, bilinear in t0 and tau), so they are only used for the
+    /// coarse sign test of HyperLine, which decides which search cells need exact
+    /// integration.
+    /// The lattice is approximate: the error of the interpolation is only measured
+    /// at random samples (see getError), so the margin of the sign test is no bound.
+    class FlowMapLattice
+    {
+    public:
+        // ------------------------------------------------------------------------- //
+        /// Computes the end positions of a lattice vertex for all t0 (outer) and tau
+        /// (inner) nodes. Nodes which are not reached by the particle are empty.
+        typedef std::function<void(const Vec3r &, std::vector<std::optional<Vec3r>> &)> VertexSampler;
+        /// Exact end position for the validation of the interpolation.
+        typedef std::function<std::optional<Vec3r>(const Vec3r &, real, real)> ExactFlowMap;
+        // ------------------------------------------------------------------------- //
+        /// The longest edge of the domain gets resolution cells, the other edges get
+        /// cells of about the same size. t0s and taus are the nodes in time.
+        FlowMapLattice(const AABB &domain,
+                       size_t resolution,
+                       const std::vector<real> &t0s,
+                       const std::vector<real> &taus);
+        // ------------------------------------------------------------------------- //
+        ~FlowMapLattice();
+        FlowMapLattice(const FlowMapLattice &) = delete;
+        FlowMapLattice &operator=(const FlowMapLattice &) = delete;
+        // ------------------------------------------------------------------------- //
+        /// Maps the file, if it exists and was built for the same lattice, flow and
+        /// search settings.
+        bool load(const std::string &filename,
+                  const std::string &flowName,
+                  const SearchParams &search);
+        // ------------------------------------------------------------------------- //
+        /// Samples all vertices in parallel and streams them into the file, which is
+        /// mapped afterwards. For each tau node, the interpolation is compared to
+        /// samplesPerNode exact flow maps at random positions and t0 nodes, the max
+        /// deviation is stored (see getError).
+        bool build(const std::string &filename,
+                   const std::string &flowName,
+                   const SearchParams &search,
+                   const VertexSampler &sampler,
+                   const ExactFlowMap &exact,
+                   size_t samplesPerNode = 100);
+        // ------------------------------------------------------------------------- //
+        /// Interpolated end position. Empty outside of the lattice or if one of the
+        /// used nodes was not reached by its particle.
+        std::optional<Vec3r> eval(const Vec3r &pos, real t0, real tau) const;
+        // ------------------------------------------------------------------------- //
+        /// Max deviation of the spatial interpolation from the exact flow map measured
+        /// after the build, for the tau nodes around tau (all nodes outside of them).
+        real getError(real tau) const;
+        size_t numVertices() const { return (m_dims[0] + 1) * (m_dims[1] + 1) * (m_dims[2] + 1); }
+        size_t getDim(size_t axis) const { return m_dims[axis]; }
+        const std::vector<real> &getT0s() const { return m_t0s; }
+        const std::vector<real> &getTaus() const { return m_taus; }
+        // ------------------------------------------------------------------------- //
+        /// Stored end positions of the vertex (i, j, k) for all t0 (outer) and tau
+        /// (inner) nodes, 0 <= i <= getDim(0) etc. Nodes which were not reached by the
+        /// particle are empty.
+        void getVertexEnds(size_t i, size_t j, size_t k, std::vector<std::optional<Vec3r>> &ends) const;
+        // ------------------------------------------------------------------------- //
+    private:
+        // ------------------------------------------------------------------------- //
+        struct FileHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t dims[3];
+            double bbox[6];
+            double search[5]; // t0_min, t0_max, tau_min, tau_max, dt
+            char flow[64];    // name of the flow
+            uint32_t num_nodes[2]; // t0, tau
+            uint64_t data_offset;  // the errors of the tau nodes are stored in front of the data
+        };
+        static constexpr const char *FILE_MAGIC = "RSLATTC";
+        static constexpr uint32_t FILE_VERSION = 1;
+        // ------------------------------------------------------------------------- //
+        FileHeader createHeader(const std::string &flowName, const SearchParams &search) const;
+        size_t dataSize() const { return numVertices() * m_t0s.size() * m_taus.size() * 3 * sizeof(float); }
+        bool map(const std::string &filename, const FileHeader &header);
+        void unmap();
+        /// Finds the interval of the nodes containing value and the weight of the
+        /// upper node.
+        static bool locate(const std::vector<real> &nodes, real value, size_t *p_index, real *p_weight);
+        // ------------------------------------------------------------------------- //
+        Vec3r m_min;
+        Vec3r m_cellSize;
+        size_t m_dims[3];
+        std::vector<real> m_t0s;
+        std::vector<real> m_taus;
+        std::vector<real> m_errors; // of the tau nodes
+        // mapped file: for each vertex (x fastest) the end positions of all t0/tau nodes
+        const float *mp_data = nullptr;
+        void *mp_mapping = nullptr;
+        size_t m_mappingSize = 0;
+        // ------------------------------------------------------------------------- //
+    };
+    // ------------------------------------------------------------------------- //
+}
+// ------------------------------------------------------------------------- //
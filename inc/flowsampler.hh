@@ -1,5 +1,6 @@
 #pragma once
 
+#include "compactflowmap.hh"
 #include "evaluator.hh"
 #include "flow.hh"
 #include "timer.hh"
@@ -7,8 +8,6 @@
 //--------------------------------------------------------------------------//
 namespace RS
 {
-  //--------------------------------------------------------------------------//
-  typedef VC::math::ode::Solution<real, Vec3r> FlowMap3D;
   //--------------------------------------------------------------------------//
   template <typename T, unsigned int n>
   class FlowSampler
@@ -16,14 +15,19 @@ namespace RS
   public:
     //--------------------------------------------------------------------------//
     FlowSampler<T, n>(const Flow<T, n> &flow)
-        : m_flow(flow), m_eval(Evaluator<T, n>(&m_flow))
+        : m_flow(flow), m_eval(Evaluator<T, n>(&m_flow)),
+          m_varEval(VariationalEvaluator<T, n>(&m_flow))
     {
       m_odeRK43.options.hmax = 0.01;
       m_odeRK43.options.rsmin = 0.00000005;
+      m_odeVariational.options.hmax = m_odeRK43.options.hmax;
+      m_odeVariational.options.rsmin = m_odeRK43.options.rsmin;
     }
     //--------------------------------------------------------------------------//
     ~FlowSampler(void) {}
     //--------------------------------------------------------------------------//
+    const Flow<T, n> &getFlow(void) const { return m_flow; }
+    //--------------------------------------------------------------------------//
     VC::math::ode::Solution<real, T> sampleFlow(
         const T &position,
         const real &t0,
@@ -60,11 +64,59 @@ namespace RS
       return state;
     }
     //--------------------------------------------------------------------------//
+    /// Integrates the pathline together with the gradient of the flow map with
+    /// respect to the seed position (see VariationalEvaluator). The solution can
+    /// be evaluated at any time between t0 and t0 + tau; use
+    /// VariationalEvaluator::position and ::gradient to unpack its states.
+    VC::math::ode::EvalState sampleFlowGradient(
+        VC::math::ode::Solution<real, typename VariationalEvaluator<T, n>::State> *p_sol,
+        const T &position,
+        const real &t0,
+        const real &tau,
+        const int &maxSteps = 0)
+    {
+      typedef VariationalEvaluator<T, n> VarEvaluator;
+      size_t id = TimerHandler::integration_timer().createTimer();
+      auto state =
+          VC::math::ode::integrate_unsteady<VC::math::ode::RK43<VarEvaluator>>(
+              m_odeVariational, &m_varEval,
+              VarEvaluator::pack(position, Flow<T, n>::Gradient::Identity()),
+              t0, t0 + tau, p_sol, false, maxSteps);
+      TimerHandler::integration_timer().deleteTimer(id);
+      assert(state != VC::math::ode::EvalState::OutOfDomain);
+      return state;
+    }
+    //--------------------------------------------------------------------------//
+    /// Like above, but only returns the end position of the pathline and the
+    /// gradient of the flow map at t0 + tau.
+    VC::math::ode::EvalState sampleFlowGradient(
+        const T &position,
+        const real &t0,
+        const real &tau,
+        T *p_end,
+        typename Flow<T, n>::Gradient *p_gradient,
+        const int &maxSteps = 0)
+    {
+      typedef VariationalEvaluator<T, n> VarEvaluator;
+      VC::math::ode::Solution<real, typename VarEvaluator::State> sol;
+      auto state = sampleFlowGradient(&sol, position, t0, tau, maxSteps);
+      if (!sol.y.empty())
+      {
+        if (p_end)
+          *p_end = VarEvaluator::position(sol.y.back());
+        if (p_gradient)
+          *p_gradient = VarEvaluator::gradient(sol.y.back());
+      }
+      return state;
+    }
+    //--------------------------------------------------------------------------//
   private:
     //--------------------------------------------------------------------------//
     VC::math::ode::RK43<Evaluator<T, n>> m_odeRK43;
+    VC::math::ode::RK43<VariationalEvaluator<T, n>> m_odeVariational;
     const Flow<T, n> &m_flow;
     Evaluator<T, n> m_eval;
+    VariationalEvaluator<T, n> m_varEval;
     //--------------------------------------------------------------------------//
   };
   //--------------------------------------------------------------------------//
@@ -20,7 +20,12 @@ namespace RS
     static real SMALL; // small value, greater than ZERO
     //--------------------------------------------------------------------------//
     /* For control over hyperlines */
-    static real SEARCHPREC; // threshold for recursive search in spatial distance
+    static real SEARCHPREC;           // threshold for recursive search in spatial distance
+    static real NEWTON_MAXEXTENT;     // max extent (space, t0 and tau) of a prefered search area to start a Newton refinement
+    static real NEWTON_TOLERANCE;     // a Newton refinement has converged if its step is below this fraction of SEARCHPREC
+    static size_t NEWTON_MAXITER;     // max iterations of a Newton refinement
+    static size_t NEWTON_MAXATTEMPTS; // max Newton refinements per searched cell before only subdividing
+    static real JACOBIAN_FDSTEP;      // step size for the finite differences of flows without an analytic gradient
     //--------------------------------------------------------------------------//
     /* Offsets for searching */
     static real RAYBACKOFFSET_REFINEMENT; // ray offset for searching before estimated intersection
@@ -44,6 +49,24 @@ namespace RS
     static real DETMIN;        // minimal value for determinant
     static real RECPOINTEQUAL; // minimum distance
     //--------------------------------------------------------------------------//
+    /* Settings for the shared flow map cache */
+    static real FLOWMAP_CACHE_QUANTUM;        // resolution of seed position and times for identifying flow maps
+    static size_t FLOWMAP_CACHE_MAXBYTES;     // memory budget for all cached flow maps
+    static real FLOWMAP_COMPACT_TOLERANCE;    // max deviation of compact flow maps from the integrated pathline
+    static bool FLOWMAP_FLOAT_STORAGE;        // store positions of compact flow maps as float
+    static size_t FLOWMAP_TILECACHE_MAXBYTES; // memory budget for the flow maps referenced by one image tile
+    static real FLOWMAP_CHUNK_TAU;            // flow maps are integrated in chunks of this length (the default SearchParams::dt), each with a fresh step size
+    //--------------------------------------------------------------------------//
+    /* Settings for the raytracer */
+    static size_t RENDER_TILESIZE;    // edge length of the square pixel tiles which are processed by one thread
+    static real RENDER_PRIOR_MARGIN;  // margin (in cells of SearchParams::dt) around the t0/tau of neighbouring pixels, which is searched first
+    static bool RENDER_RAYTASKS;      // idle threads help searching the segments of other threads' rays (OpenMP tasks)
+    static real LATTICE_MARGIN;       // factor of the error of the flow map lattice, by which its sign test must fail
+    //--------------------------------------------------------------------------//
+    /* Settings for shadows */
+    static size_t SHADOWMAP_RESOLUTION; // texels of the longest edge of the shadow map of the RecSurface (0: exact light rays only)
+    static size_t SHADOWMAP_PCFRADIUS;  // radius (in texels) of the kernel of the percentage closer filtering
+    //--------------------------------------------------------------------------//
   };
   //--------------------------------------------------------------------------//
 }
@@ -1,18 +1,22 @@
 #pragma once
 
+#include <functional>
 #include <list>
 #include <map>
+#include <optional>
 #include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "critextractor.hh"
+#include "flowmaplattice.hh"
 #include "flowsampler.hh"
 #include "globals.hh"
 #include "hyperpoint.hh"
 #include "jobparams.hh"
 #include "recpoint.hh"
+#include "searchfrontier.hh"
 #include "types.hh"
 
 #include "vectorcuboid.hh"
@@ -57,6 +61,13 @@ namespace RS
     };
     //--------------------------------------------------------------------------//
   public:
+    //--------------------------------------------------------------------------//
+    /// Decides, whether a RecPoint found by getFirstRecirculationPoint ends the
+    /// search.
+    typedef std::function<bool(const RecPoint &)> AcceptancePredicate;
+    /// Derivative [dF/dx | dF/dt0 | dF/dtau] of the recirculation condition
+    /// F(x, t0, tau) = phi(x, t0, tau) - x.
+    typedef Eigen::Matrix<real, 3, 5> Derivative;
     //--------------------------------------------------------------------------//
     HyperLine(const Vec3r &pointA,
               const Vec3r &pointB,
@@ -84,6 +95,28 @@ namespace RS
         std::vector<RecPoint> *p_candidates = nullptr,
         int *p_stopProcess = nullptr);
     //--------------------------------------------------------------------------//
+    /// First hit mode: stops the t0/tau sweep at the first accepted RecPoint.
+    /// \param window - where a hit is expected, its cells are searched first
+    std::optional<RecPoint> getFirstRecirculationPoint(
+        const SearchParams &search,
+        const AcceptancePredicate &accept = acceptByDistance,
+        const std::optional<SearchWindow> &window = std::nullopt,
+        std::vector<RecPoint> *p_candidates = nullptr,
+        int *p_stopProcess = nullptr);
+    //--------------------------------------------------------------------------//
+    /// Default acceptance: the RecPoint is closer than Globals::SPACEEQUAL.
+    static bool acceptByDistance(const RecPoint &point);
+    //--------------------------------------------------------------------------//
+    /// Computes the recirculation condition F = phi(pos, t0, tau) - pos and
+    /// optionally its derivative, which needs the gradient of the flow map.
+    /// \return false, if the integration did not reach t0 + tau.
+    static bool evalResidual(FlowSampler3D &sampler,
+                             const Vec3r &pos,
+                             const real &t0,
+                             const real &tau,
+                             Vec3r *p_residual,
+                             Derivative *p_derivative = nullptr);
+    //--------------------------------------------------------------------------//
     RecPoint createRecPoint(const Vec3r &pos,
                             const real &t0,
                             const real &tau) const;
@@ -94,8 +127,41 @@ namespace RS
     const HyperPoint &getHyperPointB(void) const;
     FlowSampler3D *getFlowSampler(void) const;
     //--------------------------------------------------------------------------//
+    /// With a lattice, the (t0, tau)-cells are first tested with the interpolated
+    /// flow maps. Only cells which pass this test (or are not covered by the
+    /// lattice) are integrated.
+    void setLattice(const FlowMapLattice *p_lattice) { mp_lattice = p_lattice; }
+    //--------------------------------------------------------------------------//
   private:
     //--------------------------------------------------------------------------//
+    std::vector<RecursiveSearchParams> getSearchCells(const real &t0_min,
+                                                      const real &t0_max,
+                                                      const real &tau_min,
+                                                      const real &tau_max,
+                                                      const real &dt,
+                                                      const real &prec) const;
+    //--------------------------------------------------------------------------//
+    static real firstTau(const real &tau_min, const real &tau_max, const real &dt);
+    //--------------------------------------------------------------------------//
+    void prefetchFlowMaps(const real &t0_min,
+                          const real &t0_max,
+                          const real &dt,
+                          const real &tau);
+    //--------------------------------------------------------------------------//
+    void getCellFlowMaps(const real &t0_a,
+                         const real &t0_b,
+                         const real &tau_b,
+                         std::shared_ptr<FlowMap3D> *p_flowMaps);
+    //--------------------------------------------------------------------------//
+    /// Sign test of a cell with the lattice. It only fails, if one component of
+    /// the difference vectors has the same sign at all corners by more than the
+    /// error of the lattice (times Globals::LATTICE_MARGIN).
+    bool passesLatticeTest(const RecursiveSearchParams &param) const;
+    //--------------------------------------------------------------------------//
+    std::list<RecPoint> searchCell(const RecursiveSearchParams &param,
+                                   const std::shared_ptr<FlowMap3D> *p_flowMaps,
+                                   int *p_stopProcess);
+    //--------------------------------------------------------------------------//
     bool getDiffVector(Vec3r *diffVec,
                        const std::shared_ptr<FlowMap3D> *p_flowMaps,
                        const Vec3r &point_a,
@@ -104,9 +170,7 @@ namespace RS
                        const real &tau_b) const;
     //--------------------------------------------------------------------------//
     // subsampling search
-    typedef std::pair<RecursiveSearchParams,
-                      std::vector<std::shared_ptr<FlowMap3D>>>
-        SearchPair;
+    typedef SearchFrontier<RecursiveSearchParams> Frontier;
     //--------------------------------------------------------------------------//
     /** \param p_stopProcess - Flag, which is 1, when the process takes to long and
      * should be killed, and 0 else. This is not a bool, due to inability to
@@ -124,9 +188,13 @@ namespace RS
         real reqDist = -1.0,
         int *p_stopProcess = nullptr);
     //--------------------------------------------------------------------------//
-    void resampleCuboid(const SearchPair &searchSpace,
-                        std::vector<std::shared_ptr<FlowMap3D>> &subFlowMaps,
-                        std::list<SearchPair> *p_searchList);
+    bool resampleCuboid(const Frontier::Node &node);
+    //--------------------------------------------------------------------------//
+    /// Checks whether an area is small enough for refineRecPointNewton.
+    bool fitsNewtonExtent(const RecursiveSearchParams &params) const;
+    //--------------------------------------------------------------------------//
+    std::optional<RecPoint> refineRecPointNewton(
+        const RecursiveSearchParams &params) const;
     //--------------------------------------------------------------------------//
     bool reachedSamplingAccuracy(const RecursiveSearchParams &params,
                                  bool *p_time = nullptr,
@@ -140,10 +208,17 @@ namespace RS
                            std::vector<RecursiveSearchParams> *p_subParams,
                            std::vector<std::vector<int>> *p_mapIndexes);
     //--------------------------------------------------------------------------//
+    void sampleFlowMaps(size_t count,
+                        const Vec3r *p_positions,
+                        const real *p_t0,
+                        const real *p_tau,
+                        std::shared_ptr<FlowMap3D> *p_flowMaps) const;
+    //--------------------------------------------------------------------------//
     std::list<std::pair<int, bool>> computePreferedOctants(
         std::shared_ptr<FlowMap3D> *p_subFlowMaps,
         std::vector<RecursiveSearchParams> *p_subParams,
-        std::vector<std::vector<int>> *p_mapIndexes) const;
+        std::vector<std::vector<int>> *p_mapIndexes,
+        real *p_residuals = nullptr) const;
     //--------------------------------------------------------------------------//
     Vec3r m_pointA;
     Vec3r m_pointB;
@@ -152,6 +227,9 @@ namespace RS
     HyperPoint m_hyperPointA;
     HyperPoint m_hyperPointB;
     FlowSampler3D *mp_flowSampler;
+    const FlowMapLattice *mp_lattice = nullptr;
+
+    Frontier m_frontier; // reused by all searches of this line
     //--------------------------------------------------------------------------//
   };
   //--------------------------------------------------------------------------//
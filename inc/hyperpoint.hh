@@ -21,6 +21,10 @@ namespace RS
     //--------------------------------------------------------------------------//
     const std::shared_ptr<FlowMap3D> getFlowMap(const real &t0, const real &tau);
     //--------------------------------------------------------------------------//
+    /// Returns the stored flow map for t0 and the direction of tau without
+    /// computing or extending it (nullptr if there is none).
+    std::shared_ptr<FlowMap3D> findFlowMap(const real &t0, const real &tau) const;
+    //--------------------------------------------------------------------------//
     void addFlowMap(const real &t0,
                     const real &tau,
                     std::shared_ptr<FlowMap3D> flow_map);
@@ -38,6 +42,7 @@ namespace RS
     Vec3r m_pos;
     FlowSampler3D *mp_flowSampler;
     //--------------------------------------------------------------------------//
+    /// flow maps by start time and direction of the integration (+1 / -1)
     std::map<std::pair<real, real>, std::shared_ptr<FlowMap3D>> m_flowMaps;
     //--------------------------------------------------------------------------//
   };
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <sstream>
 
 #include "aabb.hh"
@@ -48,6 +49,38 @@ namespace RS
     real tau_max = 15.0;
     real dt = 0.2;
     real prec = Globals::SEARCHPREC;
+    // rays stop the t0/tau sweep at the first accepted RecPoint instead of taking the
+    // one nearest to the ray origin; faster, but may return a different point
+    bool first_hit = false;
+    //--------------------------------------------------------------------------//
+  };
+  //--------------------------------------------------------------------------//
+
+  //--------------------------------------------------------------------------//
+  /// Part of the (t0, tau) search space where a RecPoint is expected, e.g. from
+  /// the RecPoints of neighbouring rays. It is searched before the rest.
+  struct SearchWindow
+  {
+    //--------------------------------------------------------------------------//
+    SearchWindow(const real &t0_val, const real &tau_val)
+        : t0(t0_val, t0_val), tau(tau_val, tau_val) {}
+    //--------------------------------------------------------------------------//
+    /// Enlarges the window so that it contains (t0_val, tau_val).
+    void extend(const real &t0_val, const real &tau_val)
+    {
+      t0 = Range(std::min(t0.min, t0_val), std::max(t0.max, t0_val));
+      tau = Range(std::min(tau.min, tau_val), std::max(tau.max, tau_val));
+    }
+    //--------------------------------------------------------------------------//
+    /// Enlarges the window by margin on each side.
+    void widen(const real &margin)
+    {
+      t0 = Range(t0.min - margin, t0.max + margin);
+      tau = Range(tau.min - margin, tau.max + margin);
+    }
+    //--------------------------------------------------------------------------//
+    Range t0;
+    Range tau;
     //--------------------------------------------------------------------------//
   };
   //--------------------------------------------------------------------------//
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "aabb.hh"
+#include "jobparams.hh"
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+    // ------------------------------------------------------------------------- //
+    /// Coarse uniform grid over the domain of a RecSurface, which marks the cells
+    /// where a RecPoint might exist. Rays skip the HyperLine searches of segments
+    /// which only touch empty cells. The grid is built by RecSurface (see
+    /// RecSurface::useOccupancyGrid) and can be saved to disk, so it is shared by
+    /// all cameras and passes of a setup.
+    /// The grid is approximate: a cell is marked empty if the sign test of the
+    /// residuals at its corners fails, and the cells are dilated once. This is not
+    /// a bound, so RecPoints of residuals which cross zero between the vertices can
+    /// be missed.
+    class OccupancyGrid
+    {
+    public:
+        // ------------------------------------------------------------------------- //
+        /// Creates a grid with all cells occupied. The longest edge of the domain gets
+        /// resolution cells, the other edges get cells of about the same size.
+        OccupancyGrid(const AABB &domain, size_t resolution);
+        // ------------------------------------------------------------------------- //
+        size_t getDim(size_t axis) const { return m_dims[axis]; }
+        size_t numCells() const { return m_cells.size(); }
+        size_t numOccupied() const;
+        // ------------------------------------------------------------------------- //
+        /// Position of the vertex (i, j, k), 0 <= i <= getDim(0) etc.
+        Vec3r getVertex(size_t i, size_t j, size_t k) const;
+        // ------------------------------------------------------------------------- //
+        bool isOccupied(size_t i, size_t j, size_t k) const { return m_cells[index(i, j, k)]; }
+        void setOccupied(size_t i, size_t j, size_t k, bool occupied) { m_cells[index(i, j, k)] = occupied; }
+        // ------------------------------------------------------------------------- //
+        /// Checks whether any cell touched by the bounding box of the segment is
+        /// occupied. Positions outside of the grid count as occupied.
+        bool isOccupied(const Vec3r &pA, const Vec3r &pB) const;
+        // ------------------------------------------------------------------------- //
+        /// Marks all cells as occupied, which have an occupied neighbor (including
+        /// the diagonal ones).
+        void dilate();
+        // ------------------------------------------------------------------------- //
+        /// Saves the grid together with the flow and search settings it was built for.
+        bool save(const std::string &filename,
+                  const std::string &flowName,
+                  const SearchParams &search) const;
+        // ------------------------------------------------------------------------- //
+        /// Loads the grid, if the file exists and was built for the same domain,
+        /// resolution, flow and search settings.
+        bool load(const std::string &filename,
+                  const std::string &flowName,
+                  const SearchParams &search);
+        // ------------------------------------------------------------------------- //
+    private:
+        // ------------------------------------------------------------------------- //
+        struct FileHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t dims[3];
+            double bbox[6];
+            double search[5]; // t0_min, t0_max, tau_min, tau_max, dt
+            char flow[64];    // name of the flow
+        };
+        static constexpr const char *FILE_MAGIC = "RSOCCGR";
+        static constexpr uint32_t FILE_VERSION = 1;
+        // ------------------------------------------------------------------------- //
+        FileHeader createHeader(const std::string &flowName, const SearchParams &search) const;
+        size_t index(size_t i, size_t j, size_t k) const { return (k * m_dims[1] + j) * m_dims[0] + i; }
+        // ------------------------------------------------------------------------- //
+        Vec3r m_min;
+        Vec3r m_cellSize;
+        size_t m_dims[3];
+        std::vector<uint8_t> m_cells; // 1 if a RecPoint might exist in the cell
+        // ------------------------------------------------------------------------- //
+    };
+    // ------------------------------------------------------------------------- //
+}
+// ------------------------------------------------------------------------- //
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "camera.hh"
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+  //--------------------------------------------------------------------------//
+  /// Orthographic cameras cast parallel rays, which start on the image plane.
+  ///
+  /// The image plane goes through the eye and is orthogonal to the direction from
+  /// the eye to the look-at point. Its width is given in world units, its height
+  /// follows from the resolution. Everything in front of the plane is visible.
+  /// This camera class constructs a right-handed coordinate system.
+  class OrthographicCamera : public Camera
+  {
+  private:
+    //--------------------------------------------------------------------------//
+    Vec3r m_up, m_eye, m_lookat, m_n, m_u, m_v;
+    double m_plane_half_width, m_plane_half_height;
+    Vec3r m_bottom_left;
+    Vec3r m_plane_base_x, m_plane_base_y;
+    //--------------------------------------------------------------------------//
+  public:
+    //--------------------------------------------------------------------------//
+    /// Constructor generates bottom left image plane pixel position and pixel
+    /// offset size. up must not be parallel to the viewing direction.
+    OrthographicCamera(const Vec3r &eye,
+                       const Vec3r &lookat,
+                       double plane_width,
+                       size_t res_x,
+                       size_t res_y,
+                       const Vec3r &up);
+    //--------------------------------------------------------------------------//
+    OrthographicCamera(const Vec3r &eye,
+                       const Vec3r &lookat,
+                       double plane_width,
+                       size_t res_x,
+                       size_t res_y,
+                       CamUp up_axis);
+    //--------------------------------------------------------------------------//
+    Ray ray(double x, double y) const override;
+    //--------------------------------------------------------------------------//
+    Vec2r projection(const Vec3r &pos) const override;
+    //--------------------------------------------------------------------------//
+    std::shared_ptr<Camera> create_increased(size_t multiplier) const override;
+    //--------------------------------------------------------------------------//
+    /// Returns the distance of a point in front of the image plane.
+    real depth(const Vec3r &pos) const { return (m_eye - pos) | m_n; }
+    //--------------------------------------------------------------------------//
+    make_clonable(Camera, OrthographicCamera);
+    //--------------------------------------------------------------------------//
+  };
+  //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
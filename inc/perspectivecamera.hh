@@ -9,12 +9,6 @@
 //--------------------------------------------------------------------------//
 namespace RS
 {
-  //--------------------------------------------------------------------------//
-  enum class CamUp
-  {
-    Y,
-    Z
-  };
   //--------------------------------------------------------------------------//
   /// Perspective cameras are able to cast rays from one point called 'eye'
   /// through an image plane.
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+    // ------------------------------------------------------------------------- //
+    /// Worklist of the iterative image passes (shadow sharpening, post processing
+    /// of the refinement), which retest pixels next to pixels whose state changed.
+    /// The first iteration visits the 4-neighbourhood of the seed pixels, each later
+    /// one only the 4-neighbourhood of the pixels changed by the iteration before,
+    /// instead of sweeping over the whole image again.
+    /// The pixels of an iteration are visited in parallel. The visitor must only
+    /// read the state of the previous iteration; the changes are applied by the
+    /// caller after iterate() returned (see changed()). The worklists are sorted,
+    /// so the iterations do not depend on the number of threads.
+    class PixelFrontier
+    {
+    public:
+        // ------------------------------------------------------------------------- //
+        typedef std::function<bool(size_t cam_index)> Predicate;
+        // ------------------------------------------------------------------------- //
+        PixelFrontier(size_t width, size_t height);
+        // ------------------------------------------------------------------------- //
+        /// Replaces the worklist by the 4-neighbourhood of all pixels for which
+        /// is_seed holds.
+        void seed(const Predicate &is_seed);
+        // ------------------------------------------------------------------------- //
+        bool empty() const { return m_work.empty(); }
+        size_t size() const { return m_work.size(); }
+        // ------------------------------------------------------------------------- //
+        /// Visits all pixels of the worklist in parallel. visit returns whether the
+        /// state of the pixel changed. Afterwards, the worklist contains the
+        /// 4-neighbourhood of the changed pixels. Returns the number of changed pixels.
+        size_t iterate(const Predicate &visit);
+        // ------------------------------------------------------------------------- //
+        /// Pixels changed by the last iteration (sorted).
+        const std::vector<size_t> &changed() const { return m_changed; }
+        // ------------------------------------------------------------------------- //
+    private:
+        // ------------------------------------------------------------------------- //
+        /// Fills the worklist with the neighbours of the given pixels.
+        void expand(const std::vector<size_t> &pixels);
+        // ------------------------------------------------------------------------- //
+        size_t m_width, m_height;
+        std::vector<size_t> m_work;
+        std::vector<size_t> m_changed;
+        std::vector<uint8_t> m_queued; // marks pixels already in the next worklist
+        // ------------------------------------------------------------------------- //
+    };
+    // ------------------------------------------------------------------------- //
+}
+//--------------------------------------------------------------------------//
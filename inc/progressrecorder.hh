@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <thread>
+
+#include "rsintersection.hh"
+
+// --------------------------------------------------------------------------- //
+namespace RS
+{
+    // --------------------------------------------------------------------------- //
+    /// Collects the results of finished rays from many worker threads and hands
+    /// them to a single writer thread. The workers only append to a lock-free
+    /// multi-producer single-consumer queue, so they never wait for each other.
+    /// All bookkeeping (ProgressSaver updates, saving, console output) is done by
+    /// the handler, which is only called on the writer thread.
+    class ProgressRecorder
+    {
+    public:
+        // --------------------------------------------------------------------------- //
+        struct Record
+        {
+            RSIntersection rsi;
+            bool domain_intersected; // was the domain of the RecSurface tested
+            bool tested;             // was a search actually executed for the ray
+        };
+        // --------------------------------------------------------------------------- //
+        typedef std::function<void(const Record &)> Handler;
+        // --------------------------------------------------------------------------- //
+        ProgressRecorder(const Handler &handler);
+        // --------------------------------------------------------------------------- //
+        /// Calls finish().
+        ~ProgressRecorder();
+        // --------------------------------------------------------------------------- //
+        ProgressRecorder(const ProgressRecorder &) = delete;
+        ProgressRecorder &operator=(const ProgressRecorder &) = delete;
+        // --------------------------------------------------------------------------- //
+        /// Adds a record. Can be called by any thread and never blocks.
+        void push(const Record &record);
+        // --------------------------------------------------------------------------- //
+        /// Waits until the writer thread handled all records and stops it. Records
+        /// must not be pushed afterwards.
+        void finish();
+        // --------------------------------------------------------------------------- //
+    private:
+        // --------------------------------------------------------------------------- //
+        struct Node
+        {
+            std::atomic<Node *> next{nullptr};
+            std::optional<Record> record; // empty for the stub
+            Node() = default;
+            Node(const Record &r) : record{r} {}
+        };
+        // --------------------------------------------------------------------------- //
+        /// Appends a node to the queue (producer side).
+        void pushNode(Node *node);
+        // --------------------------------------------------------------------------- //
+        /// Removes the oldest node from the queue or returns nullptr if it is empty
+        /// (consumer side, only called by the writer thread).
+        Node *popNode();
+        // --------------------------------------------------------------------------- //
+        /// Loop of the writer thread.
+        void writerLoop();
+        // --------------------------------------------------------------------------- //
+        Handler m_handler;
+        std::atomic<Node *> m_head; // most recently pushed node
+        Node *mp_tail;              // oldest node (only used by the writer thread)
+        Node m_stub;                // keeps the queue non-empty
+        std::atomic<bool> m_stop;
+        std::thread m_thread;
+        // --------------------------------------------------------------------------- //
+    };
+    // --------------------------------------------------------------------------- //
+}
+// --------------------------------------------------------------------------- //
@@ -13,7 +13,11 @@ namespace RS
     /// Therefore, the calculation can be interrupted.
     /// StartPosition indicates at which the program has to continue with the normal
     /// search for futher RecPoints.
-    /// Attention: Works only if the points are inserted in approximately correct order.
+    /// Points may be inserted out of order (e.g. tile by tile), but all points before
+    /// the start index have to be inserted before it can advance.
+    /// The progress is stored as binary, checksummed records which are appended to a
+    /// log, so saving only costs the new records. From time to time the log is
+    /// compacted into a snapshot. The old text format can still be loaded.
     class ProgressSaver
     {
     private:
@@ -22,14 +26,27 @@ namespace RS
         std::vector<RSIntersection> saved;   // contains data for found RecPoints
         std::vector<RSIntersection> waiting; // contains all out-of-order updates (positives and negatives) in correct order
 
-        bool complete_rewrite;
-        size_t next_save_index;                 // index for "saved" indicating which points still need to be written to the file
-        size_t count_waiting_positives;         // indicates how many points in "waiting" are RecPoints
-        const std::string file_start, file_vec; // location / name of the save files
+        std::vector<RSIntersection> updates;       // updated points before the start index which still need to be written
+        size_t next_save_index;                    // index for "saved" indicating which points still need to be written to the file
+        size_t count_waiting_positives;            // indicates how many points in "waiting" are RecPoints
+        size_t log_records;                        // number of records in the log file
+        bool needs_snapshot;                       // the log does not describe the current state (e.g. after loading text files)
+        const std::string file_start, file_vec;    // location / name of the old text save files
+        const std::string file_log, file_snapshot; // location / name of the binary save files
 
         size_t width, height;
         size_t **index_map;
         // --------------------------------------------------------------------------- //
+        /// Loads the binary snapshot and replays the log. Returns false if there
+        /// are no binary save files.
+        bool loadBinary(const Camera &cam);
+        // --------------------------------------------------------------------------- //
+        /// Loads the old text save files.
+        void loadText(const Camera &cam);
+        // --------------------------------------------------------------------------- //
+        /// Writes all saved points into a new snapshot and empties the log.
+        void writeSnapshot();
+        // --------------------------------------------------------------------------- //
     public:
         // --------------------------------------------------------------------------- //
         ProgressSaver(const std::string &save_dir, size_t cam_width, size_t cam_height);
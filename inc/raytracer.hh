@@ -1,6 +1,8 @@
 #pragma once
 
 #include <omp.h> // parallelization
+#include <optional>
+#include <unordered_map>
 #include <vector>
 
 #include "camera.hh"
@@ -33,6 +35,23 @@ namespace RS
     /// Save all unsaved data from the progress saver and stores both textures.
     virtual void saveToDisc();
     //--------------------------------------------------------------------------//
+    /// Returns the number of square tiles (edge length Globals::RENDER_TILESIZE)
+    /// which cover the image. Tiles are numbered row by row.
+    size_t numTiles() const;
+    //--------------------------------------------------------------------------//
+    /// Returns the camera indices of all pixels of a tile which are not smaller
+    /// than start_index, in row-major order.
+    std::vector<size_t> getTilePixels(size_t tile, size_t start_index = 0) const;
+    //--------------------------------------------------------------------------//
+    /// Returns the (t0, tau) window which is searched first for the pixel (x, y).
+    /// It covers the RecPoints of the already rendered neighbours (left pixel and
+    /// upper row) in hits, or last_hit if there is none, widened by
+    /// Globals::RENDER_PRIOR_MARGIN.
+    std::optional<SearchWindow> getPriorWindow(size_t x,
+                                               size_t y,
+                                               const std::unordered_map<size_t, Vec2r> &hits,
+                                               const std::optional<Vec2r> &last_hit) const;
+    //--------------------------------------------------------------------------//
   public:
     //--------------------------------------------------------------------------//
     Raytracer(std::shared_ptr<Camera> cam,
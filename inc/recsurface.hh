@@ -1,10 +1,13 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 
 #include "camera.hh"
+#include "flowmaplattice.hh"
 #include "hyperline.hh"
 #include "jobparams.hh"
+#include "occupancygrid.hh"
 #include "progresssaver.hh"
 #include "renderable.hh"
 #include "rsintersection.hh"
@@ -22,8 +25,46 @@ namespace RS
         std::shared_ptr<Flow3D> p_flow;
         DataParams m_data;
         SearchParams m_search;
+        HyperLine::AcceptancePredicate m_accept = HyperLine::acceptByDistance;
+        std::shared_ptr<const OccupancyGrid> mp_occupancy; // segments in empty cells are skipped
+        std::shared_ptr<const FlowMapLattice> mp_lattice;  // approximate sign test of the HyperLines
         // ------------------------------------------------------------------------- //
-        std::optional<RecPoint> getRecPoint(HyperLine &hl, const Ray &ray) const;
+        std::optional<RecPoint> getRecPoint(HyperLine &hl,
+                                            const Ray &ray,
+                                            const std::optional<SearchWindow> &window = std::nullopt) const;
+        // ------------------------------------------------------------------------- //
+        /// Decides whether the segment between two points of a ray is searched.
+        typedef std::function<bool(const Vec3r &, const Vec3r &)> SegmentFilter;
+        // ------------------------------------------------------------------------- //
+        /// Searches the HyperLines of the ray between i_min and i_max (one per
+        /// DataParams::step_size) and returns the RecPoint of the nearest segment with a
+        /// hit. Inside a parallel region, idle threads of the team help with the
+        /// segments (see Globals::RENDER_RAYTASKS); segments behind a hit are skipped.
+        std::optional<RecPoint> searchSegments(const Ray &ray,
+                                               real i_min,
+                                               real i_max,
+                                               const SegmentFilter &needs_test,
+                                               const std::optional<SearchWindow> &window = std::nullopt) const;
+        // ------------------------------------------------------------------------- //
+        /// Marks the cells of the grid as empty, where the sign test of the residuals
+        /// fails for all t0/tau cells of the search.
+        void buildOccupancyGrid(OccupancyGrid &grid) const;
+        // ------------------------------------------------------------------------- //
+        /// Returns the t0 and tau values of the nodes of the search cells.
+        void getSearchNodes(std::vector<real> &t0s, std::vector<real> &taus) const;
+        // ------------------------------------------------------------------------- //
+        /// Computes phi(pos) on the nodes of the t0/tau search grid (t0 in the outer, tau
+        /// in the inner order). Nodes which are not reached by the particle are empty.
+        std::vector<std::optional<Vec3r>> sampleEndPositions(const Vec3r &pos,
+                                                             FlowSampler3D &sampler) const;
+        // ------------------------------------------------------------------------- //
+        /// Computes (phi(pos) - pos) / tau on the nodes of the t0/tau search grid (t0 in
+        /// the outer, tau in the inner order). The division removes the trivial zero at
+        /// tau = 0, but keeps the RecPoints. Nodes which are not reached by the particle
+        /// are empty.
+        std::vector<std::optional<Vec3r>> sampleResiduals(const Vec3r &pos,
+                                                          FlowSampler3D &sampler,
+                                                          size_t *p_num_taus) const;
         // ------------------------------------------------------------------------- //
         bool doesLineNeedTest(const Vec3r &pA,
                               const Vec3r &pB,
@@ -40,6 +81,30 @@ namespace RS
         const DataParams &getDataParams() const { return m_data; }
         const SearchParams &getSearchParams() const { return m_search; }
         // ------------------------------------------------------------------------- //
+        /// Sets the predicate which ends the search of a HyperLine in first hit mode
+        /// (see SearchParams::first_hit).
+        void setAcceptancePredicate(const HyperLine::AcceptancePredicate &accept) { m_accept = accept; }
+        // ------------------------------------------------------------------------- //
+        /// Loads the occupancy grid of the domain from the file or builds it (in
+        /// parallel) and saves it there. The longest edge of the domain gets resolution
+        /// cells. Afterwards all searches skip the segments in empty cells. The grid is
+        /// approximate (see OccupancyGrid), so it is not used unless requested.
+        /// If a flow map lattice with the same resolution is used, the grid is built
+        /// from its vertices, so call useFlowMapLattice first.
+        void useOccupancyGrid(const std::string &filename, size_t resolution);
+        void setOccupancyGrid(std::shared_ptr<const OccupancyGrid> grid) { mp_occupancy = grid; }
+        const std::shared_ptr<const OccupancyGrid> &getOccupancyGrid() const { return mp_occupancy; }
+        // ------------------------------------------------------------------------- //
+        /// Maps the flow map lattice of the domain from the file or builds it (in
+        /// parallel) there. The longest edge of the domain gets resolution cells.
+        /// Afterwards the HyperLines of the searches skip the (t0, tau)-cells, the
+        /// interpolated sign test of which fails clearly (see HyperLine::setLattice).
+        /// The lattice is approximate (see FlowMapLattice), so it is not used unless
+        /// requested.
+        void useFlowMapLattice(const std::string &filename, size_t resolution);
+        void setFlowMapLattice(std::shared_ptr<const FlowMapLattice> lattice) { mp_lattice = lattice; }
+        const std::shared_ptr<const FlowMapLattice> &getFlowMapLattice() const { return mp_lattice; }
+        // ------------------------------------------------------------------------- //
         /// Returns the ingoing and outgoing intersections of a ray with the domain.
         /// Search range can be defined.
         std::optional<Vec2r> getDomainIntersections(const Ray &ray,
@@ -48,10 +113,13 @@ namespace RS
         // ------------------------------------------------------------------------- //
         /// Searches for a recirculation point on the given ray und returns a RSIntersection.
         /// The cam_index will be the max value and must be set manually afterwards.
+        /// window is a (t0, tau) range where a hit is expected (e.g. from neighbouring
+        /// rays), which is searched first.
         RSIntersection searchIntersection(const Ray &ray,
                                           real begin_at = 0.0,
                                           real end_at = std::numeric_limits<real>::max(),
-                                          bool *needed_integration = nullptr) const;
+                                          bool *needed_integration = nullptr,
+                                          const std::optional<SearchWindow> &window = std::nullopt) const;
         // ------------------------------------------------------------------------- //
         /// More complex iteration through the space by considering already calculated
         /// rays from the original scan of the space. Does only check HyperLines which
@@ -76,6 +144,23 @@ namespace RS
                                  real offset_space,
                                  size_t max_steps_smaller = 1) const;
         // ------------------------------------------------------------------------- //
+        /// Estimates the normals of many RecPoints like estimateFlowNormal, but the
+        /// HyperLines of the layouts are snapped to a lattice with the spacing
+        /// offset_space. RecPoints close to each other share most of their lines,
+        /// so each line is searched only once for all of them. If a RecPoint does
+        /// not get enough points, estimateFlowNormal is used with half the spacing.
+        /// Normals which could not be estimated are zero vectors.
+        std::vector<Vec3r> estimateFlowNormals(const std::vector<const RSIntersection *> &rsis,
+                                               real offset_space,
+                                               size_t max_steps_smaller = 1) const;
+        // ------------------------------------------------------------------------- //
+        /// Computes the normal of a given RecPoint from the derivative of the
+        /// recirculation condition (see HyperLine::evalResidual). Its null space spans
+        /// the tangent space of the surface in (x, t0, tau); the normal is orthogonal
+        /// to the spatial parts. Needs a single integration and no further searches.
+        /// Returns a zero vector, if the derivative is degenerated.
+        Vec3r estimateJacobianNormal(const RecPoint &rp, const Ray &ray) const;
+        // ------------------------------------------------------------------------- //
     private:
         // ------------------------------------------------------------------------- //
         /// Helper function for normal calculation. Executes search for RecPoints inside
@@ -86,6 +171,19 @@ namespace RS
                                 std::vector<Vec3r> &points,
                                 const SearchParams &sp) const;
         // ------------------------------------------------------------------------- //
+        /// Helper function for normal calculation. Adds the 3D positions of the found
+        /// points to the list, if they are near enough to the RecPoint in t0 and tau
+        /// and not already in the list.
+        static void addPointsToList(const std::vector<RecPoint> &found,
+                                    const RecPoint &rp,
+                                    std::vector<Vec3r> &points);
+        // ------------------------------------------------------------------------- //
+        /// Helper function for normal calculation. Averages the normals of the triangles
+        /// between the RecPoint and each pair of points (needs at least two points).
+        static Vec3r normalFromPoints(const RecPoint &rp,
+                                      const Ray &ray,
+                                      const std::vector<Vec3r> &points);
+        // ------------------------------------------------------------------------- //
         /// Helper function for normal calculation. Executes seach for RecPoints by cube
         /// layout.
         void addNeighborhoodByCube(const RecPoint &rp,
@@ -73,11 +73,14 @@ namespace RS
         /// it is located on the ray.
         /// In addition, the user can get information whether the domain of the
         /// recirculation surface object was intersected (and therefore checked)
+        /// window is a (t0, tau) range where a RecPoint is expected, e.g. from the
+        /// neighbouring pixels.
         std::array<color, 2> raytracing(const Ray &ray,
                                         RSIntersection &rsi_result,
                                         bool &rs_domain_intersected,
                                         real begin_at = 0.0,
-                                        real end_at = std::numeric_limits<real>::max());
+                                        real end_at = std::numeric_limits<real>::max(),
+                                        const std::optional<SearchWindow> &window = std::nullopt);
         // ------------------------------------------------------------------------- //
     };
     // ------------------------------------------------------------------------- //
@@ -54,7 +54,9 @@ namespace RS
     class SetupSquaredCylinder : public SceneSetup
     {
     public:
-        SetupSquaredCylinder(real ray_step_size = 0.0025, real time_step_size = 0.1)
+        /// approximate enables the flow map lattice and the occupancy grid, which skip
+        /// search cells and segments, but may miss RecPoints.
+        SetupSquaredCylinder(real ray_step_size = 0.0025, real time_step_size = 0.1, bool approximate = false)
         {
             Vec3r dMin(0.5, -0.65, 0.01), dMax(2.5, 0.65, 5.99);
             DataParams data(dMin, dMax, ray_step_size);
@@ -74,8 +76,18 @@ namespace RS
             }
             Vec2r time_range(0.0, 0.08 * file_vec.size());
 
-            std::shared_ptr<Flow3D> flow = std::make_shared<AmiraDataSet>(file_vec, time_range);
+            // the files are converted once into a binary cache, which is mapped by later runs
+            std::string cache_file = path + "_" + std::to_string(file_vec.size()) + ".rsgrid";
+            std::shared_ptr<Flow3D> flow = std::make_shared<AmiraDataSet>(file_vec, time_range, cache_file);
             RecSurface rec_surface{flow, data, search};
+            if (approximate)
+            {
+                // most (t0, tau)-cells are rejected by the interpolated flow maps
+                rec_surface.useFlowMapLattice(path + "_" + std::to_string(file_vec.size()) + ".rslattice", 32);
+                // large parts of the domain contain no RecPoints, their segments are skipped
+                // (the grid is built from the vertices of the lattice)
+                rec_surface.useOccupancyGrid(path + "_" + std::to_string(file_vec.size()) + ".rsoccupancy", 32);
+            }
 
             Vec3r light_dir{-0.2, -1.0, 0};
 
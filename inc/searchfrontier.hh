@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "compactflowmap.hh"
+#include "types.hh"
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+  //--------------------------------------------------------------------------//
+  /// Frontier of a best-first subdivision search. The nodes are kept in a binary
+  /// heap and refer to the flow maps of their corners by slot indices into a
+  /// pool. A slot is freed (and its flow map released) as soon as no node in the
+  /// frontier references it anymore. clear() keeps the allocated storage, so a
+  /// frontier which is reused for many searches does not allocate after the first
+  /// ones.
+  /// Preferred nodes (found by the trilinear search) come first, deeper ones
+  /// before coarser ones. All other nodes are ordered by their residual.
+  template <typename Params>
+  class SearchFrontier
+  {
+  public:
+    //--------------------------------------------------------------------------//
+    typedef uint32_t Slot;
+    //--------------------------------------------------------------------------//
+    struct Node
+    {
+      Params params;
+      Slot maps[4];   // slots of the flow maps of the corners
+      bool preferred; // the trilinear search found a critical point
+      unsigned level; // subdivision depth
+      real residual;  // smallest distance between seed and end position of the corners
+      uint64_t seq;   // insertion order, keeps the order stable for ties
+    };
+    //--------------------------------------------------------------------------//
+    /// Removes all nodes and releases all flow maps.
+    void clear(void)
+    {
+      m_heap.clear();
+      m_maps.clear();
+      m_refs.clear();
+      m_free.clear();
+      m_seq = 0;
+    }
+    //--------------------------------------------------------------------------//
+    bool empty(void) const { return m_heap.empty(); }
+    size_t size(void) const { return m_heap.size(); }
+    //--------------------------------------------------------------------------//
+    /// Number of flow maps which are currently referenced by the frontier.
+    size_t numFlowMaps(void) const { return m_maps.size() - m_free.size(); }
+    //--------------------------------------------------------------------------//
+    /// Stores a flow map in a free slot. The slot is freed again by collect(), if
+    /// no node references it.
+    Slot addFlowMap(const std::shared_ptr<FlowMap3D> &flowMap)
+    {
+      if (m_free.empty())
+      {
+        m_maps.push_back(flowMap);
+        m_refs.push_back(0);
+        return Slot(m_maps.size() - 1);
+      }
+      Slot slot = m_free.back();
+      m_free.pop_back();
+      m_maps[slot] = flowMap;
+      m_refs[slot] = 0;
+      return slot;
+    }
+    //--------------------------------------------------------------------------//
+    const std::shared_ptr<FlowMap3D> &flowMap(Slot slot) const { return m_maps[slot]; }
+    //--------------------------------------------------------------------------//
+    void push(const Params &params,
+              const Slot *p_maps,
+              bool preferred,
+              unsigned level,
+              real residual)
+    {
+      Node node{params, {p_maps[0], p_maps[1], p_maps[2], p_maps[3]}, preferred, level, residual, m_seq++};
+      for (Slot slot : node.maps)
+        ++m_refs[slot];
+      m_heap.push_back(node);
+      std::push_heap(m_heap.begin(), m_heap.end(), &SearchFrontier::lowerPriority);
+    }
+    //--------------------------------------------------------------------------//
+    /// Removes the best node. Its flow maps stay valid until release() is called.
+    Node pop(void)
+    {
+      std::pop_heap(m_heap.begin(), m_heap.end(), &SearchFrontier::lowerPriority);
+      Node node = m_heap.back();
+      m_heap.pop_back();
+      return node;
+    }
+    //--------------------------------------------------------------------------//
+    /// Drops the references of a popped node.
+    void release(const Node &node)
+    {
+      for (Slot slot : node.maps)
+      {
+        --m_refs[slot];
+        collect(slot);
+      }
+    }
+    //--------------------------------------------------------------------------//
+    /// Frees the slot, if it is not referenced anymore.
+    void collect(Slot slot)
+    {
+      if (0 == m_refs[slot] && m_maps[slot])
+      {
+        m_maps[slot].reset();
+        m_free.push_back(slot);
+      }
+    }
+    //--------------------------------------------------------------------------//
+  private:
+    //--------------------------------------------------------------------------//
+    static bool lowerPriority(const Node &a, const Node &b)
+    {
+      if (a.preferred != b.preferred)
+        return b.preferred;
+      if (a.preferred && a.level != b.level)
+        return a.level < b.level;
+      if (a.residual != b.residual)
+        return a.residual > b.residual;
+      return a.seq > b.seq;
+    }
+    //--------------------------------------------------------------------------//
+    std::vector<Node> m_heap;
+    std::vector<std::shared_ptr<FlowMap3D>> m_maps;
+    std::vector<uint32_t> m_refs;
+    std::vector<Slot> m_free;
+    uint64_t m_seq = 0;
+    //--------------------------------------------------------------------------//
+  };
+  //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 #include "directionallight.hh"
 #include "phong.hh"
 #include "raytracer.hh"
+#include "shadowmap.hh"
 
 // -------------------------------------------------------------------------- //
 namespace RS
@@ -25,8 +28,9 @@ namespace RS
         size_t m_cam_width, m_cam_height;
         const std::string m_save_dir;
 
-        std::vector<Vec3r> m_normals;  // in fact, does only save normals for RecSurface
-        std::vector<bool> m_in_shadow; // does contain info for both RecSurface and common objects
+        std::vector<Vec3r> m_normals;     // in fact, does only save normals for RecSurface
+        std::vector<uint8_t> m_in_shadow; // does contain info for both RecSurface and common objects (one byte
+                                          // per pixel, so pixels can be written by different threads)
         bool m_is_normals_ready;
         bool m_is_shadows_ready;
         bool m_is_shadows_sharp;
@@ -36,6 +40,7 @@ namespace RS
         color m_back_col;
 
         NormalCalcStrategy m_current_normal_strategy;
+        std::unique_ptr<ShadowMap> m_shadow_map; // shadows of the RecSurface (see Globals::SHADOWMAP_RESOLUTION)
         // -------------------------------------------------------------------------- //
     public:
         // -------------------------------------------------------------------------- //
@@ -59,7 +64,8 @@ namespace RS
         // -------------------------------------------------------------------------- //
         /// Calculates the shadows for each found intersection of the scene (RecSurface
         /// and common objects). Does only start calculation if the shadows are currently
-        /// not available.
+        /// not available. The shadows of the RecSurface are looked up in a shadow map,
+        /// which is rendered first; light rays are only searched where it is ambiguous.
         void calcShadows();
         // -------------------------------------------------------------------------- //
         /// Retests the rims of the shadows by recalculation each part of the light
@@ -93,8 +99,9 @@ namespace RS
         std::string getTauSaveLocation(NormalCalcStrategy strategy, bool shadow_on) const;
         // -------------------------------------------------------------------------- //
         /// Checks all objects of the scene (inclusive the RecSurface) for intersections
-        /// with the light ray.
-        bool isInShadow(const Vec3r &point) const;
+        /// with the light ray. The RecSurface is looked up in the shadow map, if there
+        /// is one; needed_light_ray tells whether the light ray had to be searched.
+        bool isInShadow(const Vec3r &point, bool *needed_light_ray = nullptr) const;
         // -------------------------------------------------------------------------- //
         /// Estimates the normal by the neighboring pixels. Needs to have at least two
         /// touching neighbors with 5D-neighboring RecPoints to estimate the normal.
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "orthographiccamera.hh"
+#include "raytracer.hh"
+
+// -------------------------------------------------------------------------- //
+namespace RS
+{
+    // -------------------------------------------------------------------------- //
+    /// Depth map of the RecSurface seen from a directional light. The scene is
+    /// rendered by a Raytracer with an orthographic camera looking along the light,
+    /// so each texel is one light ray, which is searched once for its first
+    /// RecPoint (and the progress is saved like for any other rendering).
+    /// Afterwards a shadow query only compares the depth of the point with the
+    /// depths of the texels around it (percentage closer filtering). Near
+    /// discontinuities of the depth map the texels disagree; there the query gives
+    /// no answer and an exact light ray is needed.
+    class ShadowMap
+    {
+    public:
+        // -------------------------------------------------------------------------- //
+        /// light_dir is the direction in which the light travels. The longest edge of
+        /// the domain, projected onto the plane orthogonal to it, gets resolution texels.
+        ShadowMap(std::shared_ptr<Scene> scene,
+                  const Vec3r &light_dir,
+                  size_t resolution,
+                  const std::string &save_dir);
+        // -------------------------------------------------------------------------- //
+        /// Renders the light rays which were not saved by an earlier execution.
+        void render();
+        // -------------------------------------------------------------------------- //
+        /// Returns whether the RecSurface casts a shadow on the point, if all texels of
+        /// the kernel (see Globals::SHADOWMAP_PCFRADIUS) agree, and nothing else.
+        std::optional<bool> isInShadow(const Vec3r &pos) const;
+        // -------------------------------------------------------------------------- //
+        const OrthographicCamera &getCamera() const { return *m_cam; }
+        // -------------------------------------------------------------------------- //
+    private:
+        // -------------------------------------------------------------------------- //
+        std::shared_ptr<OrthographicCamera> m_cam;
+        std::unique_ptr<Raytracer> m_raytracer;
+        real m_bias;                // depth difference below which a point does not shadow itself
+        std::vector<real> m_depths; // depth of the first RecPoint of each texel (infinite for none)
+        // -------------------------------------------------------------------------- //
+    };
+    // -------------------------------------------------------------------------- //
+}
+// -------------------------------------------------------------------------- //
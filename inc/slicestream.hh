@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+  //--------------------------------------------------------------------------//
+  /// Streams equally sized blocks of floats (e.g. the time slices of a grid)
+  /// from a binary file. Only a limited number of slices is resident; the least
+  /// recently used one is dropped when a new slice is loaded. Whenever a slice
+  /// is requested, a background thread prefetches the next slices in the
+  /// direction of the access (forward or backward integration). At most
+  /// maxResident - 2 slices are prefetched, so the pair of slices in use is not
+  /// dropped for them.
+  /// Dropped slices stay valid as long as they are referenced somewhere else.
+  class SliceStream
+  {
+  public:
+    //--------------------------------------------------------------------------//
+    typedef std::shared_ptr<const std::vector<float>> Slice;
+    //--------------------------------------------------------------------------//
+    /// \param offset - position of the first slice in the file (bytes)
+    /// \param sliceSize - number of floats per slice
+    /// \param maxResident - maximum number of slices in memory
+    /// \param prefetch - number of slices loaded ahead of a requested one
+    SliceStream(const std::string &filename,
+                size_t offset,
+                size_t sliceSize,
+                int numSlices,
+                size_t maxResident,
+                int prefetch);
+    //--------------------------------------------------------------------------//
+    ~SliceStream(void);
+    //--------------------------------------------------------------------------//
+    SliceStream(const SliceStream &) = delete;
+    SliceStream &operator=(const SliceStream &) = delete;
+    //--------------------------------------------------------------------------//
+    bool isOpen(void) const { return m_fd >= 0; }
+    //--------------------------------------------------------------------------//
+    /// Returns the slice with the given index. It is read from the file if it
+    /// is not resident; throws std::runtime_error if it can not be read. The
+    /// slices after it in the given direction (+1 or -1) are prefetched.
+    Slice getSlice(int index, int direction = 1);
+    //--------------------------------------------------------------------------//
+  private:
+    //--------------------------------------------------------------------------//
+    struct Entry
+    {
+      Slice data;
+      std::list<int>::iterator lru_pos;
+    };
+    //--------------------------------------------------------------------------//
+    /// Reads a slice from the file without holding the lock. Returns nullptr if
+    /// the file is too short or can not be read.
+    Slice readSlice(int index) const;
+    //--------------------------------------------------------------------------//
+    /// Inserts a slice as most recently used one and drops the least recently
+    /// used slices. The lock must be held by the caller.
+    Slice insert(int index, const Slice &slice);
+    //--------------------------------------------------------------------------//
+    /// Loop of the prefetching thread.
+    void prefetchLoop(void);
+    //--------------------------------------------------------------------------//
+    int m_fd = -1;
+    size_t m_offset;
+    size_t m_sliceSize;
+    int m_numSlices;
+    size_t m_maxResident;
+    int m_prefetch;
+    //--------------------------------------------------------------------------//
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::list<int> m_lru; // most recently used slice is in front
+    std::unordered_map<int, Entry> m_slices;
+    std::deque<int> m_requests; // slices which should be prefetched
+    bool m_stop = false;
+    std::thread m_thread;
+    //--------------------------------------------------------------------------//
+  };
+  //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
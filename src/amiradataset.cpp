@@ -1,9 +1,16 @@
 #include "amiradataset.hh"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
 #include <iostream>
+#include <random>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -32,15 +39,31 @@ namespace RS
                                const Vec2r &timeInfo)
         : Flow3D(&ads_bbox[0], "Amira"), m_filenames(filenames)
     {
-        ads_bbox[6] = timeInfo[0];
-        ads_bbox[7] = timeInfo[1];
+        ads_bbox[6] = m_timeRange[0] = timeInfo[0];
+        ads_bbox[7] = m_timeRange[1] = timeInfo[1];
+        init();
+        Flow3D::init(&ads_bbox[0]);
+    }
+
+    //--------------------------------------------------------------------------//
+    AmiraDataSet::AmiraDataSet(const std::vector<std::string> &filenames,
+                               const Vec2r &timeInfo,
+                               const std::string &cacheFile,
+                               size_t maxResidentSlices)
+        : Flow3D(&ads_bbox[0], "Amira"), m_filenames(filenames), m_cacheFile(cacheFile),
+          m_maxResidentSlices(maxResidentSlices)
+    {
+        ads_bbox[6] = m_timeRange[0] = timeInfo[0];
+        ads_bbox[7] = m_timeRange[1] = timeInfo[1];
         init();
         Flow3D::init(&ads_bbox[0]);
     }
 
     //--------------------------------------------------------------------------//
     AmiraDataSet::AmiraDataSet(const AmiraDataSet &other)
-        : Flow3D(other.mp_domain, other.m_name), m_filenames(other.m_filenames)
+        : Flow3D(other.mp_domain, other.m_name), m_filenames(other.m_filenames),
+          m_timeRange{other.m_timeRange[0], other.m_timeRange[1]}, m_cacheFile(other.m_cacheFile),
+          m_maxResidentSlices(other.m_maxResidentSlices)
     {
         *ads_bbox = *other.ads_bbox;
         init();
@@ -52,33 +75,284 @@ namespace RS
     AmiraDataSet::operator=(const AmiraDataSet &other)
     {
         m_filenames = other.m_filenames;
+        m_timeRange[0] = other.m_timeRange[0];
+        m_timeRange[1] = other.m_timeRange[1];
+        m_cacheFile = other.m_cacheFile;
+        m_maxResidentSlices = other.m_maxResidentSlices;
         *ads_bbox = *other.ads_bbox;
         init();
         Flow3D::init(&ads_bbox[0]);
+        renewId();
         return *this;
     }
 
     //--------------------------------------------------------------------------//
     AmiraDataSet::~AmiraDataSet(void)
     {
+        unmapCache();
         delete[] mp_gridData;
     }
 
     //--------------------------------------------------------------------------//
     Vec3r
     AmiraDataSet::v(real t, const Vec3r &pos) const
+    {
+        return interpolate(prepareTime(t), pos);
+    }
+
+    //--------------------------------------------------------------------------//
+    void
+    AmiraDataSet::v_batch(const real *t, const Vec3r *pos, Vec3r *out, size_t n) const
+    {
+        // the gather kernel needs the whole float32 grid in one array; streamed
+        // slices and the double precision grid are interpolated one by one
+        if (!mp_floatData || mp_sliceStream)
+        {
+            for (size_t i = 0; i < n; ++i)
+                out[i] = interpolate(prepareTime(t[i]), pos[i]);
+            return;
+        }
+
+        constexpr size_t W = 16;
+        const int dims[4] = {m_dimX, m_dimY, m_dimZ, m_dimT};
+        const size_t strides[4] = {1, size_t(m_dimX), size_t(m_dimX) * m_dimY, m_sliceStride};
+        // offsets of the upper neighbors are the same for all samples
+        size_t offset[4];
+        for (int d = 0; d < 4; ++d)
+            offset[d] = dims[d] > 1 ? strides[d] : 0;
+        const float *p_data = mp_floatData;
+        const size_t cs = m_componentStride;
+
+        for (size_t first = 0; first < n; first += W)
+        {
+            size_t count = min(W, n - first);
+            alignas(64) real coord[4][W], weight[4][W], vel[3][W];
+            alignas(64) size_t base[W];
+            for (size_t i = 0; i < count; ++i)
+            {
+                for (int d = 0; d < 3; ++d)
+                    coord[d][i] = pos[first + i][d];
+                coord[3][i] = prepareTime(t[first + i]);
+            }
+
+            // lower node and weights in each dimension (clamped to the grid)
+#pragma omp simd
+            for (size_t i = 0; i < count; ++i)
+            {
+                size_t b = 0;
+                for (int d = 0; d < 4; ++d)
+                {
+                    real s = (coord[d][i] - m_gridOrigin[d]) * m_gridInvSpacing[d];
+                    s = std::min(std::max(s, real(0)), real(dims[d] - 1));
+                    int idx = std::min(static_cast<int>(s), std::max(dims[d] - 2, 0));
+                    weight[d][i] = s - idx;
+                    b += idx * strides[d];
+                }
+                base[i] = b;
+            }
+
+            // gather the 16 nodes of the xyzt-cell from the component arrays
+#pragma omp simd
+            for (size_t i = 0; i < count; ++i)
+            {
+                real vx = 0.0, vy = 0.0, vz = 0.0;
+                for (int c = 0; c < 16; ++c)
+                {
+                    size_t idx = base[i];
+                    real w = 1.0;
+                    for (int d = 0; d < 4; ++d)
+                    {
+                        bool upper = c & (1 << d);
+                        idx += upper ? offset[d] : 0;
+                        w *= upper ? weight[d][i] : 1.0 - weight[d][i];
+                    }
+                    vx += w * p_data[idx];
+                    vy += w * p_data[cs + idx];
+                    vz += w * p_data[2 * cs + idx];
+                }
+                vel[0][i] = vx;
+                vel[1][i] = vy;
+                vel[2][i] = vz;
+            }
+
+            for (size_t i = 0; i < count; ++i)
+                out[first + i] = Vec3r(vel[0][i], vel[1][i], vel[2][i]);
+        }
+    }
+
+    //--------------------------------------------------------------------------//
+    AmiraDataSet::Gradient
+    AmiraDataSet::jacobian(real t, const Vec3r &pos) const
+    {
+        real time = prepareTime(t);
+        Gradient gradient = Gradient::Zero();
+        for (int j = 0; j < 3; ++j)
+        {
+            if (m_gridInvSpacing[j] <= 0.0)
+                continue;
+            real h = 0.5 / m_gridInvSpacing[j];
+            Vec3r pos_a = pos;
+            Vec3r pos_b = pos;
+            pos_a[j] = max(pos[j] - h, mp_domain[2 * j]);
+            pos_b[j] = min(pos[j] + h, mp_domain[2 * j + 1]);
+            real dist = pos_b[j] - pos_a[j];
+            if (dist <= 0.0)
+                continue;
+            Vec3r diff = (interpolate(time, pos_b) - interpolate(time, pos_a)) / dist;
+            for (int i = 0; i < 3; ++i)
+                gradient(i, j) = diff[i];
+        }
+        return gradient;
+    }
+
+    //--------------------------------------------------------------------------//
+    real
+    AmiraDataSet::useFloatStorage(bool validate, size_t numSamples)
+    {
+        if (!mp_gridData)
+            return 0.0;
+
+        // random sample points inside of the grid
+        vector<Vec3r> positions;
+        vector<real> times;
+        vector<Vec3r> reference;
+        if (validate)
+        {
+            mt19937 generator(42);
+            uniform_real_distribution<real> dist(0.0, 1.0);
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                Vec3r pos;
+                for (int d = 0; d < 3; ++d)
+                    pos[d] = ads_bbox[2 * d] + dist(generator) * (ads_bbox[2 * d + 1] - ads_bbox[2 * d]);
+                positions.push_back(pos);
+                times.push_back(ads_bbox[6] + dist(generator) * (ads_bbox[7] - ads_bbox[6]));
+                reference.push_back(interpolate(times.back(), pos));
+            }
+        }
+
+        // convert the grid into the same layout as the cache file
+        size_t slice_size = size_t(m_dimX) * m_dimY * m_dimZ;
+        m_componentStride = (slice_size + 15) / 16 * 16;
+        m_sliceStride = 3 * m_componentStride;
+        m_floatGrid.assign(m_sliceStride * m_dimT, 0.0f);
+        for (int l = 0; l < m_dimT; ++l)
+            for (int c = 0; c < 3; ++c)
+                for (size_t idx = 0; idx < slice_size; ++idx)
+                    m_floatGrid[l * m_sliceStride + c * m_componentStride + idx] =
+                        static_cast<float>(mp_gridData[l * slice_size + idx][c]);
+        mp_floatData = m_floatGrid.data();
+        delete[] mp_gridData;
+        mp_gridData = nullptr;
+
+        if (!validate)
+            return 0.0;
+        real max_dev = 0.0;
+        real max_rel = 0.0;
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            real dev = (interpolate(times[i], positions[i]) - reference[i]).norm();
+            max_dev = std::max(max_dev, dev);
+            if (reference[i].norm() > Globals::ZERO)
+                max_rel = std::max(max_rel, dev / reference[i].norm());
+        }
+        cout << "Float32 storage of " << getName() << ": max deviation " << max_dev
+             << " (relative " << max_rel << ") on " << numSamples << " samples" << endl;
+        return max_dev;
+    }
+
+    //--------------------------------------------------------------------------//
+    real
+    AmiraDataSet::prepareTime(real t) const
     {
         if (isSteady())
             t = m_steady_time;
         if (isPeriodic())
             t = clampTime(t);
+        return t;
+    }
+
+    //--------------------------------------------------------------------------//
+    /// Trilinear interpolation in one time slice. The functor fetch(idx) returns
+    /// the vector stored at the node with the local index idx of the slice.
+    template <typename Fetch>
+    static inline Vec3r
+    interpolateSlice(const Fetch &fetch, size_t base, const size_t *offset, const real *weight)
+    {
         Vec3r v(0.0, 0.0, 0.0);
-        Vec4r tempPos(pos[0], pos[1], pos[2], t);
-        Vec4rField tempField(m_vec4Grid);
-        tempField.value(v, tempPos); // ASDF here we get a warning
+        for (int c = 0; c < 8; ++c)
+        {
+            size_t idx = base;
+            real w = 1.0;
+            for (int d = 0; d < 3; ++d)
+            {
+                bool upper = c & (1 << d);
+                idx += upper ? offset[d] : 0;
+                w *= upper ? weight[d] : 1.0 - weight[d];
+            }
+            v += fetch(idx) * w;
+        }
         return v;
     }
 
+    //--------------------------------------------------------------------------//
+    inline Vec3r
+    AmiraDataSet::interpolate(real t, const Vec3r &pos) const
+    {
+        const real coord[4] = {pos[0], pos[1], pos[2], t};
+        const int dims[4] = {m_dimX, m_dimY, m_dimZ, m_dimT};
+        size_t stride = 1;
+        size_t base = 0;
+        size_t offset[4];
+        real weight[4];
+        int slice = 0;
+        for (int d = 0; d < 4; ++d)
+        {
+            // continuous index in the grid, clamped to its boundary
+            real s = (coord[d] - m_gridOrigin[d]) * m_gridInvSpacing[d];
+            s = std::min(std::max(s, real(0)), real(dims[d] - 1));
+            int idx = std::min(static_cast<int>(s), std::max(dims[d] - 2, 0));
+            weight[d] = s - idx;
+            if (d < 3)
+            {
+                base += idx * stride;
+                offset[d] = dims[d] > 1 ? stride : 0;
+                stride *= dims[d];
+            }
+            else
+            {
+                slice = idx;
+                offset[d] = dims[d] > 1 ? 1 : 0;
+            }
+        }
+
+        // interpolate in both neighboring time slices and blend them linearly
+        const float *p_floatSlices[2] = {nullptr, nullptr};
+        if (mp_floatData || mp_sliceStream)
+            getFloatSlices(slice, slice + offset[3], &p_floatSlices[0], &p_floatSlices[1]);
+        Vec3r v[2];
+        for (int k = 0; k < 2; ++k)
+        {
+            size_t l = slice + k * offset[3];
+            if (p_floatSlices[k])
+            {
+                const float *p_slice = p_floatSlices[k];
+                size_t cs = m_componentStride;
+                v[k] = interpolateSlice([p_slice, cs](size_t idx) {
+                    return Vec3r(p_slice[idx], p_slice[cs + idx], p_slice[2 * cs + idx]);
+                },
+                                        base, offset, weight);
+            }
+            else
+            {
+                const Vec3r *p_slice = mp_gridData + l * stride;
+                v[k] = interpolateSlice([p_slice](size_t idx) { return p_slice[idx]; },
+                                        base, offset, weight);
+            }
+        }
+        return v[0] * (1.0 - weight[3]) + v[1] * weight[3];
+    }
+
     //--------------------------------------------------------------------------//
     void
     AmiraDataSet::init(const real *bbox)
@@ -90,6 +364,41 @@ namespace RS
     void
     AmiraDataSet::init(void)
     {
+        unmapCache();
+        mp_sliceStream.reset();
+        m_floatGrid.clear();
+        // a valid cache file replaces the loading of the AmiraMesh files; it is
+        // created slice by slice if it does not exist yet
+        if (!m_cacheFile.empty())
+        {
+            CacheHeader header;
+            if (readCacheHeader(&header) || (convertToCache() && readCacheHeader(&header)))
+            {
+                applyCacheHeader(header);
+                bool ready = false;
+                if (m_maxResidentSlices > 0)
+                {
+                    mp_sliceStream = make_unique<SliceStream>(m_cacheFile,
+                                                              header.data_offset,
+                                                              header.slice_stride,
+                                                              header.dims[3],
+                                                              m_maxResidentSlices,
+                                                              PREFETCH_SLICES);
+                    ready = mp_sliceStream->isOpen();
+                }
+                else
+                    ready = mapCache(header);
+                if (ready)
+                {
+                    setupGrid();
+                    return;
+                }
+            }
+            cout << "Could not use cache file " << m_cacheFile << ", load the files directly." << endl;
+            unmapCache();
+            mp_sliceStream.reset();
+        }
+
         // time component is defined by the number of files we have
         m_dimT = static_cast<int>(m_filenames.size());
 
@@ -155,21 +464,262 @@ namespace RS
 
         //-------- HACK END ----------
 
-        real xmin = ads_bbox[0];
-        real xmax = ads_bbox[1];
-        real ymin = ads_bbox[2];
-        real ymax = ads_bbox[3];
-        real zmin = ads_bbox[4];
-        real zmax = ads_bbox[5];
-        real tmin = ads_bbox[6];
-        real tmax = ads_bbox[7];
-
-        Vec4rGrid tempGrid(mp_gridData,
-                           VC::mvfields::d4::msize_t(m_dimX, m_dimY, m_dimZ, m_dimT));
-        tempGrid.set_origin(Vec4rGrid::coord_t(xmin, ymin, zmin, tmin));
-        tempGrid.set_extent(
-            Vec4rGrid::coord_t(xmax - xmin, ymax - ymin, zmax - zmin, tmax - tmin));
-        m_vec4Grid = tempGrid;
+        setupGrid();
+    }
+
+    //--------------------------------------------------------------------------//
+    void
+    AmiraDataSet::setupGrid(void)
+    {
+        // the samples are located at the nodes of the uniform grid
+        const int dims[4] = {m_dimX, m_dimY, m_dimZ, m_dimT};
+        for (int d = 0; d < 4; ++d)
+        {
+            real min = ads_bbox[2 * d];
+            real max = ads_bbox[2 * d + 1];
+            m_gridOrigin[d] = min;
+            m_gridInvSpacing[d] = (dims[d] > 1 && max > min) ? (dims[d] - 1) / (max - min) : 0.0;
+        }
+    }
+
+    //--------------------------------------------------------------------------//
+    bool
+    AmiraDataSet::convertToCache(void)
+    {
+        // write to a temporary file first, so that other processes never see a
+        // partially written cache
+        string tmp_file = m_cacheFile + ".tmp" + to_string(getpid());
+        ofstream out(tmp_file, ios::out | ios::binary | ios::trunc);
+        if (!out)
+        {
+            cout << "Could not write cache file " << m_cacheFile << endl;
+            return false;
+        }
+
+        // the files are converted one after another, so only one slice is in memory
+        int num_files = static_cast<int>(m_filenames.size());
+        CacheHeader header;
+        vector<float> buffer;
+        bool success = num_files > 0;
+        for (int fileId = 0; success && fileId < num_files; fileId++)
+        {
+            cout << "\rConvert file " << fileId + 1 << "/" << num_files << flush;
+            int dims[3] = {m_dimX, m_dimY, m_dimZ};
+            float *data;
+            if (!loadFile(m_filenames[fileId], &data, fileId == (num_files - 1)))
+            {
+                success = false;
+                break;
+            }
+            if (0 == fileId)
+            {
+                // the first file specifies the grid size; data sets with only
+                // one time slice get a second (equal) one
+                m_dimT = max(num_files, 2);
+                if (1 == num_files)
+                    ads_bbox[7] = 1.0;
+                header = createCacheHeader();
+                out.write(reinterpret_cast<const char *>(&header), sizeof(CacheHeader));
+                buffer.assign(header.data_offset - sizeof(CacheHeader), 0.0f);
+                out.write(reinterpret_cast<const char *>(buffer.data()), header.data_offset - sizeof(CacheHeader));
+            }
+            else if (dims[0] != m_dimX || dims[1] != m_dimY || dims[2] != m_dimZ)
+            {
+                cout << "\nThe lattice of " << m_filenames[fileId] << " differs." << endl;
+                success = false;
+            }
+
+            // structure of arrays: each slice holds the x, y and z components
+            size_t slice_size = size_t(m_dimX) * m_dimY * m_dimZ;
+            buffer.assign(header.component_stride, 0.0f);
+            for (int copy = 0; success && copy < (1 == num_files ? 2 : 1); ++copy)
+                for (int c = 0; c < 3; ++c)
+                {
+                    for (size_t idx = 0; idx < slice_size; ++idx)
+                        buffer[idx] = data[idx * m_components + c];
+                    out.write(reinterpret_cast<const char *>(buffer.data()), sizeof(float) * buffer.size());
+                }
+            delete[] data;
+        }
+        out.close();
+        if (!success || !out || 0 != rename(tmp_file.c_str(), m_cacheFile.c_str()))
+        {
+            cout << "Could not write cache file " << m_cacheFile << endl;
+            remove(tmp_file.c_str());
+            return false;
+        }
+        cout << "Wrote cache file " << m_cacheFile << endl;
+        return true;
+    }
+
+    //--------------------------------------------------------------------------//
+    bool
+    AmiraDataSet::readCacheHeader(CacheHeader *p_header) const
+    {
+        int fd = open(m_cacheFile.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat file_stat;
+        bool valid = 0 == fstat(fd, &file_stat) &&
+                     size_t(file_stat.st_size) >= sizeof(CacheHeader) &&
+                     sizeof(CacheHeader) == size_t(pread(fd, p_header, sizeof(CacheHeader), 0)) &&
+                     isValidCacheHeader(*p_header) &&
+                     size_t(file_stat.st_size) >= p_header->data_offset + sizeof(float) * p_header->slice_stride * p_header->dims[3];
+        close(fd);
+        if (!valid)
+            cout << "Cache file " << m_cacheFile << " does not match the data set." << endl;
+        return valid;
+    }
+
+    //--------------------------------------------------------------------------//
+    void
+    AmiraDataSet::applyCacheHeader(const CacheHeader &header)
+    {
+        m_componentStride = header.component_stride;
+        m_sliceStride = header.slice_stride;
+        m_dimX = header.dims[0];
+        m_dimY = header.dims[1];
+        m_dimZ = header.dims[2];
+        m_dimT = header.dims[3];
+        m_components = 3;
+        for (int i = 0; i < 8; ++i)
+            ads_bbox[i] = header.bbox[i];
+    }
+
+    //--------------------------------------------------------------------------//
+    bool
+    AmiraDataSet::mapCache(const CacheHeader &header)
+    {
+        int fd = open(m_cacheFile.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        size_t size = header.data_offset + sizeof(float) * header.slice_stride * header.dims[3];
+        void *p_mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (MAP_FAILED == p_mapping)
+            return false;
+
+        mp_mapping = p_mapping;
+        m_mappingSize = size;
+        mp_floatData = reinterpret_cast<const float *>(static_cast<const char *>(p_mapping) + header.data_offset);
+        return true;
+    }
+
+    //--------------------------------------------------------------------------//
+    void
+    AmiraDataSet::unmapCache(void)
+    {
+        if (mp_mapping)
+            munmap(mp_mapping, m_mappingSize);
+        mp_mapping = nullptr;
+        m_mappingSize = 0;
+        mp_floatData = nullptr;
+    }
+
+    //--------------------------------------------------------------------------//
+    AmiraDataSet::CacheHeader
+    AmiraDataSet::createCacheHeader(void) const
+    {
+        CacheHeader header;
+        memset(&header, 0, sizeof(CacheHeader));
+        memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+        header.version = CACHE_VERSION;
+        header.num_files = m_filenames.size();
+        header.time_range[0] = m_timeRange[0];
+        header.time_range[1] = m_timeRange[1];
+        header.fingerprint = fingerprintFiles();
+        header.dims[0] = m_dimX;
+        header.dims[1] = m_dimY;
+        header.dims[2] = m_dimZ;
+        header.dims[3] = m_dimT;
+        for (int i = 0; i < 8; ++i)
+            header.bbox[i] = ads_bbox[i];
+        // align each component array to 64 bytes and the data to a page
+        size_t slice_size = size_t(m_dimX) * m_dimY * m_dimZ;
+        header.component_stride = (slice_size + 15) / 16 * 16;
+        header.slice_stride = 3 * header.component_stride;
+        header.data_offset = 4096;
+        return header;
+    }
+
+    //--------------------------------------------------------------------------//
+    bool
+    AmiraDataSet::isValidCacheHeader(const CacheHeader &header) const
+    {
+        return 0 == memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) &&
+               CACHE_VERSION == header.version &&
+               m_filenames.size() == header.num_files &&
+               m_timeRange[0] == header.time_range[0] &&
+               m_timeRange[1] == header.time_range[1] &&
+               fingerprintFiles() == header.fingerprint &&
+               header.dims[0] > 0 && header.dims[1] > 0 && header.dims[2] > 0 && header.dims[3] > 0 &&
+               header.data_offset >= sizeof(CacheHeader);
+    }
+
+    //--------------------------------------------------------------------------//
+    uint64_t
+    AmiraDataSet::fingerprintFiles(void) const
+    {
+        // FNV-1a over the file names and their stat values (missing files count as
+        // size and time zero)
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&hash](const void *p_data, size_t size)
+        {
+            const unsigned char *p_bytes = static_cast<const unsigned char *>(p_data);
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash ^= p_bytes[i];
+                hash *= 1099511628211ull;
+            }
+        };
+        for (const string &filename : m_filenames)
+        {
+            add(filename.data(), filename.size() + 1);
+            struct stat file_stat;
+            int64_t values[3] = {0, 0, 0};
+            if (0 == stat(filename.c_str(), &file_stat))
+            {
+                values[0] = file_stat.st_size;
+                values[1] = file_stat.st_mtim.tv_sec;
+                values[2] = file_stat.st_mtim.tv_nsec;
+            }
+            add(values, sizeof(values));
+        }
+        return hash;
+    }
+
+    //--------------------------------------------------------------------------//
+    void
+    AmiraDataSet::getFloatSlices(int slice, int next, const float **p_slice, const float **p_next) const
+    {
+        if (!mp_sliceStream)
+        {
+            *p_slice = mp_floatData + slice * m_sliceStride;
+            *p_next = mp_floatData + next * m_sliceStride;
+            return;
+        }
+        // each thread keeps the last used pair of slices alive, so the stream is
+        // only asked when the integration crosses a slice boundary
+        struct Pinned
+        {
+            size_t flow_id = 0;
+            int slice = -1;
+            int next = -1;
+            SliceStream::Slice data[2];
+        };
+        thread_local Pinned pinned;
+        if (pinned.flow_id != getId() || pinned.slice != slice || pinned.next != next)
+        {
+            // a backward integration moves to lower slices, so they are prefetched
+            int direction = (pinned.flow_id == getId() && slice < pinned.slice) ? -1 : 1;
+            pinned.data[0] = mp_sliceStream->getSlice(slice, direction);
+            pinned.data[1] = mp_sliceStream->getSlice(next, direction);
+            pinned.flow_id = getId();
+            pinned.slice = slice;
+            pinned.next = next;
+        }
+        *p_slice = pinned.data[0]->data();
+        *p_next = pinned.data[1]->data();
     }
 
     // ------------------------------------------------------------------------ //
@@ -0,0 +1,301 @@
+#include "batchflowsampler.hh"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using VC::math::ode::EvalState;
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+  //--------------------------------------------------------------------------//
+  BatchFlowSampler3D::BatchFlowSampler3D(const Flow<Vec3r, 3> &flow)
+      : m_flow(flow) {}
+
+  //--------------------------------------------------------------------------//
+  void BatchFlowSampler3D::sampleFlows(size_t count,
+                                       const Vec3r *p_positions,
+                                       const real *p_t0,
+                                       const real *p_tau,
+                                       Pathline3D *const *p_sols,
+                                       EvalState *p_states,
+                                       int maxSteps,
+                                       real *p_stepSizes)
+  {
+    size_t id = TimerHandler::integration_timer().createTimer();
+    for (size_t first = 0; first < count; first += WIDTH)
+    {
+      sampleBatch(min(WIDTH, count - first),
+                  p_positions + first,
+                  p_t0 + first,
+                  p_tau + first,
+                  p_sols + first,
+                  p_states ? p_states + first : nullptr,
+                  maxSteps,
+                  p_stepSizes ? p_stepSizes + first : nullptr);
+    }
+    TimerHandler::integration_timer().deleteTimer(id);
+  }
+
+  //--------------------------------------------------------------------------//
+  void BatchFlowSampler3D::sampleBatch(size_t count,
+                                       const Vec3r *p_positions,
+                                       const real *p_t0,
+                                       const real *p_tau,
+                                       Pathline3D *const *p_sols,
+                                       EvalState *p_states,
+                                       int maxSteps,
+                                       real *p_stepSizes)
+  {
+    constexpr size_t W = WIDTH;
+    alignas(64) real t[W], t1[W], h[W], hnext[W], hmin[W], ts[W], err[W];
+    Lanes y, ys, yn, k1, k2, k3, k4, k5, kn;
+    bool active[W], outside[W], stopped[W], trial[W];
+    int steps[W];
+    EvalState states[W];
+
+    // unused lanes repeat the first seed, so that all values stay finite
+    for (size_t i = 0; i < W; ++i)
+    {
+      size_t s = i < count ? i : 0;
+      y.x[i] = p_positions[s][0];
+      y.y[i] = p_positions[s][1];
+      y.z[i] = p_positions[s][2];
+      t[i] = p_t0[s];
+      t1[i] = p_t0[s] + p_tau[s];
+      real h0 = (p_stepSizes && p_stepSizes[s] != 0.0) ? abs(p_stepSizes[s]) : options.hmax;
+      h[i] = copysign(min(min(h0, options.hmax), abs(p_tau[s])), p_tau[s]);
+      hnext[i] = abs(h[i]);
+      hmin[i] = options.rsmin * abs(p_tau[s]);
+      active[i] = i < count;
+      outside[i] = false;
+      stopped[i] = false;
+      steps[i] = 0;
+      states[i] = EvalState::Success;
+    }
+
+    // the first sample of each flow map is the seed itself
+    evalVelocity(t, y, active, &k1, outside, stopped);
+    for (size_t i = 0; i < count; ++i)
+    {
+      if (stopped[i])
+      {
+        states[i] = EvalState::ForceStop;
+        active[i] = false;
+        continue;
+      }
+      if (outside[i])
+      {
+        states[i] = EvalState::OutOfDomain;
+        active[i] = false;
+        continue;
+      }
+      p_sols[i]->push(t[i], Vec3r(y.x[i], y.y[i], y.z[i]), Vec3r(k1.x[i], k1.y[i], k1.z[i]));
+      if (t[i] == t1[i])
+        active[i] = false;
+    }
+
+    while (any_of(active, active + W, [](bool a) { return a; }))
+    {
+      fill(outside, outside + W, false);
+
+      // stage 2
+#pragma omp simd
+      for (size_t i = 0; i < W; ++i)
+      {
+        real c = h[i] / 3.0;
+        ts[i] = t[i] + c;
+        ys.x[i] = y.x[i] + c * k1.x[i];
+        ys.y[i] = y.y[i] + c * k1.y[i];
+        ys.z[i] = y.z[i] + c * k1.z[i];
+      }
+      evalVelocity(ts, ys, active, &k2, outside, stopped);
+
+      // stage 3
+#pragma omp simd
+      for (size_t i = 0; i < W; ++i)
+      {
+        real c = h[i] / 6.0;
+        ys.x[i] = y.x[i] + c * (k1.x[i] + k2.x[i]);
+        ys.y[i] = y.y[i] + c * (k1.y[i] + k2.y[i]);
+        ys.z[i] = y.z[i] + c * (k1.z[i] + k2.z[i]);
+      }
+      evalVelocity(ts, ys, active, &k3, outside, stopped);
+
+      // stage 4
+#pragma omp simd
+      for (size_t i = 0; i < W; ++i)
+      {
+        real c = h[i] / 8.0;
+        ts[i] = t[i] + h[i] / 2.0;
+        ys.x[i] = y.x[i] + c * (k1.x[i] + 3.0 * k3.x[i]);
+        ys.y[i] = y.y[i] + c * (k1.y[i] + 3.0 * k3.y[i]);
+        ys.z[i] = y.z[i] + c * (k1.z[i] + 3.0 * k3.z[i]);
+      }
+      evalVelocity(ts, ys, active, &k4, outside, stopped);
+
+      // stage 5
+#pragma omp simd
+      for (size_t i = 0; i < W; ++i)
+      {
+        real c = h[i] / 2.0;
+        ts[i] = t[i] + h[i];
+        ys.x[i] = y.x[i] + c * (k1.x[i] - 3.0 * k3.x[i] + 4.0 * k4.x[i]);
+        ys.y[i] = y.y[i] + c * (k1.y[i] - 3.0 * k3.y[i] + 4.0 * k4.y[i]);
+        ys.z[i] = y.z[i] + c * (k1.z[i] - 3.0 * k3.z[i] + 4.0 * k4.z[i]);
+      }
+      evalVelocity(ts, ys, active, &k5, outside, stopped);
+
+      // 4th order solution and the error estimate of the embedded 3rd order one
+#pragma omp simd
+      for (size_t i = 0; i < W; ++i)
+      {
+        real c = h[i] / 6.0;
+        real e = h[i] / 30.0;
+        yn.x[i] = y.x[i] + c * (k1.x[i] + 4.0 * k4.x[i] + k5.x[i]);
+        yn.y[i] = y.y[i] + c * (k1.y[i] + 4.0 * k4.y[i] + k5.y[i]);
+        yn.z[i] = y.z[i] + c * (k1.z[i] + 4.0 * k4.z[i] + k5.z[i]);
+        real ex = e * (2.0 * k1.x[i] - 9.0 * k3.x[i] + 8.0 * k4.x[i] - k5.x[i]);
+        real ey = e * (2.0 * k1.y[i] - 9.0 * k3.y[i] + 8.0 * k4.y[i] - k5.y[i]);
+        real ez = e * (2.0 * k1.z[i] - 9.0 * k3.z[i] + 8.0 * k4.z[i] - k5.z[i]);
+        real sx = options.abstol + options.reltol * max(abs(y.x[i]), abs(yn.x[i]));
+        real sy = options.abstol + options.reltol * max(abs(y.y[i]), abs(yn.y[i]));
+        real sz = options.abstol + options.reltol * max(abs(y.z[i]), abs(yn.z[i]));
+        err[i] = max(abs(ex) / sx, max(abs(ey) / sy, abs(ez) / sz));
+      }
+
+      // the derivative at the new position is needed for the output and is the
+      // first stage of the next step
+      for (size_t i = 0; i < W; ++i)
+        trial[i] = active[i] && !outside[i] && !stopped[i] && (err[i] <= 1.0 || abs(h[i]) <= hmin[i]);
+      evalVelocity(ts, yn, trial, &kn, outside, stopped);
+
+      // step size control for each lane
+      for (size_t i = 0; i < count; ++i)
+      {
+        if (!active[i])
+          continue;
+        // the flow requested to stop -> end at the last accepted position
+        if (stopped[i])
+        {
+          states[i] = EvalState::ForceStop;
+          active[i] = false;
+          continue;
+        }
+        // a stage left the domain -> approach the boundary with smaller steps
+        if (outside[i])
+        {
+          h[i] /= 2.0;
+          if (abs(h[i]) < hmin[i])
+          {
+            states[i] = EvalState::HitBoundary;
+            active[i] = false;
+          }
+          continue;
+        }
+        real fac = err[i] > 0.0 ? 0.9 * pow(err[i], -0.25) : 5.0;
+        fac = min(5.0, max(0.2, fac));
+        if (trial[i])
+        {
+          // hit the end time exactly in the last step
+          t[i] = (h[i] == t1[i] - t[i]) ? t1[i] : ts[i];
+          y.x[i] = yn.x[i];
+          y.y[i] = yn.y[i];
+          y.z[i] = yn.z[i];
+          k1.x[i] = kn.x[i];
+          k1.y[i] = kn.y[i];
+          k1.z[i] = kn.z[i];
+          p_sols[i]->push(t[i], Vec3r(y.x[i], y.y[i], y.z[i]), Vec3r(k1.x[i], k1.y[i], k1.z[i]));
+          ++steps[i];
+          if (t[i] == t1[i])
+          {
+            active[i] = false;
+            continue;
+          }
+          if (maxSteps > 0 && steps[i] >= maxSteps)
+          {
+            states[i] = EvalState::ForceStop;
+            active[i] = false;
+            continue;
+          }
+        }
+        real hn = min(options.hmax, max(hmin[i], abs(h[i]) * fac));
+        hnext[i] = hn;
+        // do not step over the end time
+        h[i] = copysign(min(hn, abs(t1[i] - t[i])), h[i]);
+      }
+    }
+
+    if (p_states)
+      for (size_t i = 0; i < count; ++i)
+        p_states[i] = states[i];
+    if (p_stepSizes)
+      for (size_t i = 0; i < count; ++i)
+        p_stepSizes[i] = hnext[i];
+  }
+
+  //--------------------------------------------------------------------------//
+  void BatchFlowSampler3D::evalVelocity(const real *t,
+                                        const Lanes &pos,
+                                        const bool *active,
+                                        Lanes *p_vel,
+                                        bool *outside,
+                                        bool *stopped) const
+  {
+    // gather the lanes which are inside the domain
+    real ts[WIDTH];
+    Vec3r ps[WIDTH], vs[WIDTH];
+    size_t lane[WIDTH];
+    size_t count = 0;
+    for (size_t i = 0; i < WIDTH; ++i)
+    {
+      p_vel->x[i] = p_vel->y[i] = p_vel->z[i] = 0.0;
+      if (!active[i])
+        continue;
+      Vec3r p(pos.x[i], pos.y[i], pos.z[i]);
+      if (!m_flow.isInside(p))
+      {
+        outside[i] = true;
+        continue;
+      }
+      ts[count] = t[i];
+      ps[count] = p;
+      lane[count++] = i;
+    }
+
+    try
+    {
+      m_flow.v_batch(ts, ps, vs, count);
+    }
+    catch (EvalState &)
+    {
+      // evaluate one by one to find the lanes which can not be evaluated
+      for (size_t j = 0; j < count; ++j)
+      {
+        try
+        {
+          vs[j] = m_flow.v(ts[j], ps[j]);
+        }
+        catch (EvalState &state)
+        {
+          vs[j] = Vec3r(0.0, 0.0, 0.0);
+          if (state == EvalState::ForceStop)
+            stopped[lane[j]] = true;
+          else
+            outside[lane[j]] = true;
+        }
+      }
+    }
+
+    // scatter the velocities back to the lanes
+    for (size_t j = 0; j < count; ++j)
+    {
+      p_vel->x[lane[j]] = vs[j][0];
+      p_vel->y[lane[j]] = vs[j][1];
+      p_vel->z[lane[j]] = vs[j][2];
+    }
+  }
+  //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
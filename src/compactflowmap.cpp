@@ -0,0 +1,217 @@
+#include "compactflowmap.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+  //--------------------------------------------------------------------------//
+  CompactFlowMap3D::CompactFlowMap3D(void) {}
+
+  //--------------------------------------------------------------------------//
+  CompactFlowMap3D::CompactFlowMap3D(const Pathline3D &pathline,
+                                     real tolerance,
+                                     bool use_float)
+      : m_isFloat(use_float)
+  {
+    size_t count = pathline.t.size();
+    if (0 == count)
+      return;
+    m_isBackward = pathline.t.back() < pathline.t.front();
+
+    // derivatives of the dense steps
+    vector<Vec3r> dys(count);
+    for (size_t k = 0; k < count; ++k)
+    {
+      Vec3r y;
+      pathline.eval_at(pathline.t[k], y, &dys[k]);
+    }
+
+    // checks if the dense output between a and b is reproduced by their Hermite
+    // curve, at the steps and at the midpoints between them
+    auto fits = [&](size_t a, size_t b) {
+      auto close = [&](real t, const Vec3r &y) {
+        Vec3r p = hermite(t,
+                          pathline.t[a], pathline.y[a], dys[a],
+                          pathline.t[b], pathline.y[b], dys[b]);
+        Vec3r d = p - y;
+        return abs(d[0]) <= tolerance && abs(d[1]) <= tolerance && abs(d[2]) <= tolerance;
+      };
+      for (size_t k = a; k < b; ++k)
+      {
+        if (k > a && !close(pathline.t[k], pathline.y[k]))
+          return false;
+        real t_mid = 0.5 * (pathline.t[k] + pathline.t[k + 1]);
+        Vec3r y_mid = hermite(t_mid,
+                              pathline.t[k], pathline.y[k], dys[k],
+                              pathline.t[k + 1], pathline.y[k + 1], dys[k + 1]);
+        if (!close(t_mid, y_mid))
+          return false;
+      }
+      return true;
+    };
+
+    // greedily choose the longest segments: the length is doubled as long as
+    // the segment fits, afterwards the limit is found by bisection
+    vector<size_t> nodes = {0};
+    size_t a = 0;
+    while (a + 1 < count)
+    {
+      size_t good = a + 1;
+      size_t len = 2;
+      while (a + len < count && fits(a, a + len))
+      {
+        good = a + len;
+        len *= 2;
+      }
+      size_t bad = min(a + len, count);
+      while (bad - good > 1)
+      {
+        size_t mid = (good + bad) / 2;
+        if (fits(a, mid))
+          good = mid;
+        else
+          bad = mid;
+      }
+      nodes.push_back(good);
+      a = good;
+    }
+
+    m_endPos = pathline.y.back();
+
+    // store the chosen nodes
+    m_t.reserve(nodes.size());
+    if (m_isFloat)
+      m_dataf.reserve(6 * nodes.size());
+    else
+      m_data.reserve(6 * nodes.size());
+    for (size_t k : nodes)
+    {
+      m_t.push_back(pathline.t[k]);
+      for (int c = 0; c < 6; ++c)
+      {
+        real v = c < 3 ? pathline.y[k][c] : dys[k][c - 3];
+        if (m_isFloat)
+          m_dataf.push_back(static_cast<float>(v));
+        else
+          m_data.push_back(v);
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------//
+  Vec3r CompactFlowMap3D::eval_position_at(real t) const
+  {
+    assert(!empty());
+    size_t count = m_t.size();
+    if (1 == count)
+      return Vec3r(value(0, 0), value(0, 1), value(0, 2));
+
+    // find the segment which contains t
+    size_t b = m_isBackward
+                   ? upper_bound(m_t.begin(), m_t.end(), t, greater<real>()) - m_t.begin()
+                   : upper_bound(m_t.begin(), m_t.end(), t) - m_t.begin();
+    b = min(max(b, size_t(1)), count - 1);
+    size_t a = b - 1;
+
+    // clamp to the integrated range
+    real t_min = min(m_t.front(), m_t.back());
+    real t_max = max(m_t.front(), m_t.back());
+    t = min(max(t, t_min), t_max);
+
+    return hermite(t,
+                   m_t[a],
+                   Vec3r(value(a, 0), value(a, 1), value(a, 2)),
+                   Vec3r(value(a, 3), value(a, 4), value(a, 5)),
+                   m_t[b],
+                   Vec3r(value(b, 0), value(b, 1), value(b, 2)),
+                   Vec3r(value(b, 3), value(b, 4), value(b, 5)));
+  }
+
+  //--------------------------------------------------------------------------//
+  void CompactFlowMap3D::setIntegrationState(VC::math::ode::EvalState state)
+  {
+    m_isStopped = state != VC::math::ode::EvalState::Success;
+  }
+
+  //--------------------------------------------------------------------------//
+  bool CompactFlowMap3D::reaches(real tau) const
+  {
+    if (empty())
+      return false;
+    // the direction of the integration must fit
+    if (abs(tau) > Globals::ZERO && (tau < 0.0) != m_isBackward)
+      return false;
+    return abs(endTime() - startTime()) + Globals::ZERO >= abs(tau);
+  }
+
+  //--------------------------------------------------------------------------//
+  real CompactFlowMap3D::reach(void) const
+  {
+    if (isStopped())
+      return numeric_limits<real>::infinity();
+    if (empty())
+      return 0.0;
+    return abs(endTime() - startTime());
+  }
+
+  //--------------------------------------------------------------------------//
+  CompactFlowMap3D CompactFlowMap3D::extended(const Pathline3D &pathline,
+                                              VC::math::ode::EvalState state) const
+  {
+    CompactFlowMap3D extension(pathline, Globals::FLOWMAP_COMPACT_TOLERANCE, m_isFloat);
+    CompactFlowMap3D result(*this);
+    if (empty())
+      result = extension;
+    else if (1 < extension.size())
+    {
+      if (1 == size())
+        result.m_isBackward = extension.m_isBackward;
+      // the first node of the extension is the last node of this flow map
+      result.m_t.insert(result.m_t.end(), extension.m_t.begin() + 1, extension.m_t.end());
+      if (m_isFloat)
+        result.m_dataf.insert(result.m_dataf.end(), extension.m_dataf.begin() + 6, extension.m_dataf.end());
+      else
+        result.m_data.insert(result.m_data.end(), extension.m_data.begin() + 6, extension.m_data.end());
+      result.m_endPos = extension.m_endPos;
+    }
+    result.setIntegrationState(state);
+    return result;
+  }
+
+  //--------------------------------------------------------------------------//
+  size_t CompactFlowMap3D::getMemoryUsage(void) const
+  {
+    return sizeof(CompactFlowMap3D) + m_t.capacity() * sizeof(real) +
+           m_data.capacity() * sizeof(real) + m_dataf.capacity() * sizeof(float);
+  }
+
+  //--------------------------------------------------------------------------//
+  Vec3r CompactFlowMap3D::hermite(real t,
+                                  real t_a,
+                                  const Vec3r &y_a,
+                                  const Vec3r &dy_a,
+                                  real t_b,
+                                  const Vec3r &y_b,
+                                  const Vec3r &dy_b)
+  {
+    real h = t_b - t_a;
+    if (0.0 == h)
+      return y_a;
+    real s = (t - t_a) / h;
+    real s2 = s * s;
+    real s3 = s2 * s;
+    real h00 = 2.0 * s3 - 3.0 * s2 + 1.0;
+    real h10 = s3 - 2.0 * s2 + s;
+    real h01 = -2.0 * s3 + 3.0 * s2;
+    real h11 = s3 - s2;
+    return y_a * h00 + dy_a * (h10 * h) + y_b * h01 + dy_b * (h11 * h);
+  }
+  //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
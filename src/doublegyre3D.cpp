@@ -1,5 +1,7 @@
 #include "doublegyre3D.hh"
 
+#include <algorithm>
+
 //--------------------------------------------------------------------------//
 namespace RS
 {
@@ -27,6 +29,7 @@ namespace RS
     m_eps = other.m_eps;
     m_omega = other.m_omega;
     Flow3D::init(other.mp_domain);
+    renewId();
     return *this;
   }
 
@@ -69,6 +72,80 @@ namespace RS
     return v;
   }
 
+  //-----------------------------------------------------------------------------------------------//
+  void
+  DoubleGyre3D::v_batch(const real *t, const Vec3r *pos, Vec3r *out, size_t n) const
+  {
+    real A = m_A;
+    real eps = m_eps;
+    real omega = m_omega;
+
+    // the time is prepared outside of the vectorized loop in chunks
+    const size_t chunk = 64;
+    real time[chunk];
+    for (size_t first = 0; first < n; first += chunk)
+    {
+      size_t m = std::min(chunk, n - first);
+      for (size_t i = 0; i < m; ++i)
+      {
+        time[i] = isSteady() ? m_steady_time : t[first + i];
+        if (isPeriodic())
+          time[i] = clampTime(time[i]);
+      }
+
+      const Vec3r *p = pos + first;
+      Vec3r *v = out + first;
+#pragma omp simd
+      for (size_t i = 0; i < m; ++i)
+      {
+        real x = p[i][0];
+        real y = p[i][1];
+        real z = p[i][2];
+
+        real a = eps * sin(omega * time[i]);
+        real b = 1.0 - 2.0 * a;
+        real f = a * x * x + b * x;
+
+        v[i][0] = -M_PI * A * sin(M_PI * f) * cos(M_PI * y);
+        v[i][1] = M_PI * A * cos(M_PI * f) * sin(M_PI * y) * (2.0 * a * x + b);
+        v[i][2] = omega / M_PI * z * (1.0 - z) * (z - 0.5 - eps * sin(2.0 * omega * time[i]));
+      }
+    }
+  }
+
+  //-----------------------------------------------------------------------------------------------//
+  DoubleGyre3D::Gradient
+  DoubleGyre3D::jacobian(real t, const Vec3r &pos) const
+  {
+    if (isSteady())
+      t = m_steady_time;
+    if (isPeriodic())
+      t = clampTime(t);
+
+    real x = pos[0];
+    real y = pos[1];
+    real z = pos[2];
+    Gradient gradient = Gradient::Zero();
+
+    real A = m_A;
+    real eps = m_eps;
+    real omega = m_omega;
+
+    real a = eps * sin(omega * t);
+    real b = 1.0 - 2.0 * a;
+    real f = a * x * x + b * x;
+    real df = 2.0 * a * x + b;
+    real c = 0.5 + eps * sin(2.0 * omega * t);
+
+    gradient(0, 0) = -M_PI * M_PI * A * cos(M_PI * f) * df * cos(M_PI * y);
+    gradient(0, 1) = M_PI * M_PI * A * sin(M_PI * f) * sin(M_PI * y);
+    gradient(1, 0) = M_PI * A * sin(M_PI * y) * (2.0 * a * cos(M_PI * f) - M_PI * sin(M_PI * f) * df * df);
+    gradient(1, 1) = M_PI * M_PI * A * cos(M_PI * f) * cos(M_PI * y) * df;
+    gradient(2, 2) = omega / M_PI * ((1.0 - 2.0 * z) * (z - c) + z * (1.0 - z));
+
+    return gradient;
+  }
+
   //-----------------------------------------------------------------------------------------------//
   bool
   DoubleGyre3D::setParameters(const real *p_params)
@@ -99,6 +176,7 @@ namespace RS
     m_A = A;
     m_omega = omega;
     m_eps = eps;
+    renewId();
   }
   //--------------------------------------------------------------------------//
 }
@@ -0,0 +1,322 @@
+#include "flowmapcache.hh"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+  //--------------------------------------------------------------------------//
+  FlowMapCache FlowMapCache::_instance{};
+  thread_local FlowMapCache::TileScope *FlowMapCache::tp_tileScope = nullptr;
+
+  //--------------------------------------------------------------------------//
+  FlowMapCache::TileScope::TileScope()
+  {
+    tp_tileScope = this;
+  }
+
+  //--------------------------------------------------------------------------//
+  FlowMapCache::TileScope::~TileScope()
+  {
+    tp_tileScope = nullptr;
+    FlowMapCache::instance().m_hits += m_hits;
+  }
+
+  //--------------------------------------------------------------------------//
+  void FlowMapCache::TileScope::add(const Key &key, const shared_ptr<FlowMap3D> &flow_map)
+  {
+    size_t bytes = estimateBytes(*flow_map);
+    if (m_bytes + bytes > Globals::FLOWMAP_TILECACHE_MAXBYTES)
+    {
+      m_flowMaps.clear();
+      m_bytes = 0;
+    }
+    // an extended flow map replaces the shorter one
+    shared_ptr<FlowMap3D> &entry = m_flowMaps[key];
+    if (entry == flow_map)
+      return;
+    if (entry)
+      m_bytes -= min(m_bytes, estimateBytes(*entry));
+    entry = flow_map;
+    m_bytes += bytes;
+  }
+
+  //--------------------------------------------------------------------------//
+  size_t FlowMapCache::KeyHash::operator()(const Key &key) const
+  {
+    // combine the hashes like boost::hash_combine
+    size_t seed = hash<size_t>{}(key.flow_id);
+    for (long long v : key.values)
+      seed ^= hash<long long>{}(v) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+    return seed;
+  }
+
+  //--------------------------------------------------------------------------//
+  FlowMapCache::FlowMapCache() : m_hits{0}, m_misses{0}
+  {
+    for (auto &shard : m_shards)
+      omp_init_lock(&shard.lck);
+  }
+
+  //--------------------------------------------------------------------------//
+  FlowMapCache::~FlowMapCache()
+  {
+    for (auto &shard : m_shards)
+      omp_destroy_lock(&shard.lck);
+  }
+
+  //--------------------------------------------------------------------------//
+  FlowMapCache::Shard &FlowMapCache::getShard(const Key &key)
+  {
+    return m_shards[KeyHash{}(key) % NUM_SHARDS];
+  }
+
+  //--------------------------------------------------------------------------//
+  FlowMapCache::Key FlowMapCache::createKey(size_t flow_id, const Vec3r &pos, real t0, real tau)
+  {
+    real q = Globals::FLOWMAP_CACHE_QUANTUM;
+    return Key{flow_id,
+               {llround(pos[0] / q), llround(pos[1] / q), llround(pos[2] / q),
+                llround(t0 / q), tau < 0.0 ? -1 : 1}};
+  }
+
+  //--------------------------------------------------------------------------//
+  real FlowMapCache::getChunkEnd(real reached)
+  {
+    real q = Globals::FLOWMAP_CHUNK_TAU;
+    // the previous chunk ended at a multiple of q up to rounding
+    return (floor(reached / q + Globals::SMALL) + 1.0) * q;
+  }
+
+  //--------------------------------------------------------------------------//
+  size_t FlowMapCache::estimateBytes(const FlowMap3D &flow_map)
+  {
+    return flow_map.getMemoryUsage();
+  }
+
+  //--------------------------------------------------------------------------//
+  shared_ptr<FlowMap3D> FlowMapCache::find(const Key &key, real tau)
+  {
+    // lock free lookup in the flow maps of the current tile
+    shared_ptr<FlowMap3D> local{};
+    if (tp_tileScope)
+    {
+      auto it = tp_tileScope->m_flowMaps.find(key);
+      if (it != tp_tileScope->m_flowMaps.end())
+      {
+        local = it->second;
+        if (local->covers(tau))
+        {
+          ++tp_tileScope->m_hits;
+          return local;
+        }
+      }
+    }
+
+    Shard &shard = getShard(key);
+    shared_ptr<FlowMap3D> result{};
+    omp_set_lock(&shard.lck);
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end())
+    {
+      // mark as most recently used
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_pos);
+      result = it->second.flow_map;
+    }
+    omp_unset_lock(&shard.lck);
+
+    // return the flow map which reaches further
+    if (!result || (local && local->reach() > result->reach()))
+      result = local;
+    if (result && result->covers(tau))
+    {
+      ++m_hits;
+      if (tp_tileScope)
+        tp_tileScope->add(key, result);
+    }
+    else
+      ++m_misses;
+    return result;
+  }
+
+  //--------------------------------------------------------------------------//
+  shared_ptr<FlowMap3D> FlowMapCache::insert(const Key &key, const shared_ptr<FlowMap3D> &flow_map)
+  {
+    Shard &shard = getShard(key);
+    size_t budget = Globals::FLOWMAP_CACHE_MAXBYTES / NUM_SHARDS;
+    size_t bytes = estimateBytes(*flow_map);
+    shared_ptr<FlowMap3D> result = flow_map;
+    omp_set_lock(&shard.lck);
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end())
+    {
+      Entry &entry = it->second;
+      // another thread might have integrated the same flow map even further
+      if (entry.flow_map->reach() >= flow_map->reach())
+        result = entry.flow_map;
+      // else the extended flow map replaces the shorter one
+      else
+      {
+        shard.bytes -= entry.bytes;
+        shard.lru.splice(shard.lru.begin(), shard.lru, entry.lru_pos);
+        entry.flow_map = flow_map;
+        entry.bytes = bytes;
+        shard.bytes += bytes;
+        evict(shard, budget);
+      }
+    }
+    // flow maps exceeding the whole budget are not cached at all
+    else if (bytes <= budget)
+    {
+      evict(shard, budget - bytes);
+      shard.lru.push_front(key);
+      shard.entries.emplace(key, Entry{flow_map, bytes, shard.lru.begin()});
+      shard.bytes += bytes;
+    }
+    omp_unset_lock(&shard.lck);
+    if (tp_tileScope)
+      tp_tileScope->add(key, result);
+    return result;
+  }
+
+  //--------------------------------------------------------------------------//
+  void FlowMapCache::evict(Shard &shard, size_t budget)
+  {
+    while (shard.bytes > budget && !shard.lru.empty())
+    {
+      auto it = shard.entries.find(shard.lru.back());
+      shard.bytes -= it->second.bytes;
+      shard.entries.erase(it);
+      shard.lru.pop_back();
+    }
+  }
+
+  //--------------------------------------------------------------------------//
+  shared_ptr<FlowMap3D> FlowMapCache::getFlowMap(const Flow<Vec3r, 3> &flow,
+                                                 const Vec3r &pos,
+                                                 real t0,
+                                                 real tau)
+  {
+    // single requests are integrated by the batch sampler as well, so a cached
+    // flow map does not depend on which path computed it first
+    BatchFlowSampler3D sampler(flow);
+    shared_ptr<FlowMap3D> flow_map;
+    getFlowMaps(sampler, 1, &pos, &t0, &tau, &flow_map);
+    return flow_map;
+  }
+
+  //--------------------------------------------------------------------------//
+  void FlowMapCache::getFlowMaps(BatchFlowSampler3D &sampler,
+                                 size_t count,
+                                 const Vec3r *p_positions,
+                                 const real *p_t0,
+                                 const real *p_tau,
+                                 shared_ptr<FlowMap3D> *p_flowMaps)
+  {
+    vector<Key> keys;
+    vector<size_t> missing;
+    for (size_t i = 0; i < count; ++i)
+    {
+      keys.push_back(createKey(sampler.getFlow().getId(), p_positions[i], p_t0[i], p_tau[i]));
+      p_flowMaps[i] = find(keys.back(), p_tau[i]);
+      if (!p_flowMaps[i] || !p_flowMaps[i]->covers(p_tau[i]))
+        missing.push_back(i);
+    }
+    if (missing.empty())
+      return;
+
+    // the missing flow maps are integrated together, one chunk per round, until
+    // each one covers its tau
+    vector<FlowMap3D> results;
+    for (size_t i : missing)
+      results.push_back(p_flowMaps[i] ? *p_flowMaps[i] : FlowMap3D());
+    vector<size_t> lanes;
+    for (size_t j = 0; j < missing.size(); ++j)
+      lanes.push_back(j);
+    while (!lanes.empty())
+    {
+      vector<Vec3r> positions;
+      vector<real> t0s, taus;
+      vector<Pathline3D> pathlines(lanes.size());
+      vector<Pathline3D *> sols;
+      vector<VC::math::ode::EvalState> states(lanes.size());
+      for (size_t j : lanes)
+      {
+        size_t i = missing[j];
+        const FlowMap3D &result = results[j];
+        real reached = result.empty() ? 0.0 : abs(result.endTime() - p_t0[i]);
+        real t_end = p_t0[i] + copysign(getChunkEnd(reached), p_tau[i]);
+        positions.push_back(result.empty() ? p_positions[i] : result.endPosition());
+        t0s.push_back(result.empty() ? p_t0[i] : result.endTime());
+        taus.push_back(t_end - t0s.back());
+        sols.push_back(&pathlines[sols.size()]);
+      }
+      sampler.sampleFlows(lanes.size(),
+                          positions.data(),
+                          t0s.data(),
+                          taus.data(),
+                          sols.data(),
+                          states.data());
+      vector<size_t> next_lanes;
+      for (size_t k = 0; k < lanes.size(); ++k)
+      {
+        size_t j = lanes[k];
+        FlowMap3D &result = results[j];
+        if (result.empty())
+        {
+          result = FlowMap3D(pathlines[k]);
+          result.setIntegrationState(states[k]);
+        }
+        else
+          result = result.extended(pathlines[k], states[k]);
+        if (!result.covers(p_tau[missing[j]]))
+          next_lanes.push_back(j);
+      }
+      lanes.swap(next_lanes);
+    }
+    for (size_t j = 0; j < missing.size(); ++j)
+      p_flowMaps[missing[j]] = insert(keys[missing[j]], make_shared<FlowMap3D>(move(results[j])));
+  }
+
+  //--------------------------------------------------------------------------//
+  void FlowMapCache::clear()
+  {
+    for (auto &shard : m_shards)
+    {
+      omp_set_lock(&shard.lck);
+      shard.entries.clear();
+      shard.lru.clear();
+      shard.bytes = 0;
+      omp_unset_lock(&shard.lck);
+    }
+  }
+
+  //--------------------------------------------------------------------------//
+  size_t FlowMapCache::getMemoryUsage()
+  {
+    size_t bytes = 0;
+    for (auto &shard : m_shards)
+    {
+      omp_set_lock(&shard.lck);
+      bytes += shard.bytes;
+      omp_unset_lock(&shard.lck);
+    }
+    return bytes;
+  }
+
+  //--------------------------------------------------------------------------//
+  void FlowMapCache::printStats()
+  {
+    size_t hits = m_hits.exchange(0), misses = m_misses.exchange(0);
+    double r = hits + misses > 0 ? double(hits) / double(hits + misses) : 0.0;
+    cout << "Flow map cache: hit rate " << r * 100.0 << "% ("
+         << hits << " / " << hits + misses << "), memory "
+         << getMemoryUsage() / (1024.0 * 1024.0) << " MiB" << endl;
+  }
+  //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
@@ -0,0 +1,300 @@
+#include "flowmaplattice.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+    //--------------------------------------------------------------------------//
+    FlowMapLattice::FlowMapLattice(const AABB &domain,
+                                   size_t resolution,
+                                   const vector<real> &t0s,
+                                   const vector<real> &taus)
+        : m_min{domain.getMin()}, m_t0s{t0s}, m_taus{taus}
+    {
+        Vec3r extent = domain.getMax() - domain.getMin();
+        real edge = max({extent[0], extent[1], extent[2]}) / max(resolution, size_t(1));
+        for (size_t i = 0; i < 3; ++i)
+        {
+            m_dims[i] = max(size_t(1), size_t(ceil(extent[i] / edge - Globals::SMALL)));
+            m_cellSize[i] = extent[i] / m_dims[i];
+        }
+    }
+
+    //--------------------------------------------------------------------------//
+    FlowMapLattice::~FlowMapLattice()
+    {
+        unmap();
+    }
+
+    //--------------------------------------------------------------------------//
+    bool FlowMapLattice::load(const string &filename,
+                              const string &flowName,
+                              const SearchParams &search)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        FileHeader header, expected = createHeader(flowName, search);
+        vector<real> errors(m_taus.size());
+        size_t errors_size = errors.size() * sizeof(real);
+        struct stat file_stat;
+        bool valid = 0 == fstat(fd, &file_stat) &&
+                     sizeof(FileHeader) == size_t(pread(fd, &header, sizeof(FileHeader), 0)) &&
+                     0 == memcmp(&header, &expected, sizeof(FileHeader)) &&
+                     size_t(file_stat.st_size) >= header.data_offset + dataSize() &&
+                     errors_size == size_t(pread(fd, errors.data(), errors_size, sizeof(FileHeader)));
+        close(fd);
+        if (!valid || !map(filename, header))
+            return false;
+        m_errors.swap(errors);
+        return true;
+    }
+
+    //--------------------------------------------------------------------------//
+    bool FlowMapLattice::build(const string &filename,
+                               const string &flowName,
+                               const SearchParams &search,
+                               const VertexSampler &sampler,
+                               const ExactFlowMap &exact,
+                               size_t samplesPerNode)
+    {
+        unmap();
+        // the file gets its name when it is complete, so an aborted build is not loaded
+        string tmp_file = filename + ".tmp" + to_string(getpid());
+        int fd = open(tmp_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        FileHeader header = createHeader(flowName, search);
+        atomic<bool> written{0 == ftruncate(fd, header.data_offset + dataSize())};
+
+        // the vertices are written as soon as they are sampled, so the lattice is
+        // never held in memory
+        size_t num_nodes = m_t0s.size() * m_taus.size();
+        size_t num_vertices = numVertices();
+        size_t done = 0;
+#pragma omp parallel for schedule(dynamic)
+        for (size_t v = 0; v < num_vertices; ++v)
+        {
+            if (!written.load())
+                continue;
+            size_t i = v % (m_dims[0] + 1), j = (v / (m_dims[0] + 1)) % (m_dims[1] + 1), k = v / ((m_dims[0] + 1) * (m_dims[1] + 1));
+            Vec3r pos{m_min[0] + i * m_cellSize[0], m_min[1] + j * m_cellSize[1], m_min[2] + k * m_cellSize[2]};
+            vector<optional<Vec3r>> ends;
+            sampler(pos, ends);
+            vector<float> block(3 * num_nodes, numeric_limits<float>::quiet_NaN());
+            for (size_t n = 0; n < min(ends.size(), num_nodes); ++n)
+                if (ends[n])
+                    for (size_t d = 0; d < 3; ++d)
+                        block[3 * n + d] = float((*ends[n])[d]);
+            size_t bytes = block.size() * sizeof(float);
+            if (bytes != size_t(pwrite(fd, block.data(), bytes, header.data_offset + v * bytes)))
+                written.store(false);
+#pragma omp critical(flowmaplattice_progress)
+            if (0 == ++done % 1000 || done == num_vertices)
+                cout << "\rFlow map lattice: vertex " << done << " / " << num_vertices << flush;
+        }
+        cout << endl;
+
+        // the header is written last, so the file is only valid after the validation
+        bool success = written.load() && map(tmp_file, header);
+        if (success)
+        {
+            // random positions and t0 nodes for each tau node, the exact flow maps of
+            // which are integrated in parallel
+            mt19937 generator(42);
+            uniform_real_distribution<real> unit(0.0, 1.0);
+            uniform_int_distribution<size_t> t0_node(0, m_t0s.size() - 1);
+            size_t num_samples = samplesPerNode * m_taus.size();
+            vector<Vec3r> positions(num_samples);
+            vector<real> t0s(num_samples);
+            for (size_t s = 0; s < num_samples; ++s)
+            {
+                for (size_t d = 0; d < 3; ++d)
+                    positions[s][d] = m_min[d] + unit(generator) * m_dims[d] * m_cellSize[d];
+                t0s[s] = m_t0s[t0_node(generator)];
+            }
+            vector<real> errors(num_samples, 0.0);
+#pragma omp parallel for schedule(dynamic)
+            for (size_t s = 0; s < num_samples; ++s)
+            {
+                real tau = m_taus[s / samplesPerNode];
+                optional<Vec3r> approx = eval(positions[s], t0s[s], tau);
+                if (!approx)
+                    continue;
+                optional<Vec3r> end = exact(positions[s], t0s[s], tau);
+                if (end)
+                    errors[s] = (*approx - *end).norm();
+            }
+            m_errors.assign(m_taus.size(), 0.0);
+            for (size_t s = 0; s < num_samples; ++s)
+                m_errors[s / samplesPerNode] = max(m_errors[s / samplesPerNode], errors[s]);
+            size_t errors_size = m_errors.size() * sizeof(real);
+            success = errors_size == size_t(pwrite(fd, m_errors.data(), errors_size, sizeof(FileHeader))) &&
+                      sizeof(FileHeader) == size_t(pwrite(fd, &header, sizeof(FileHeader), 0));
+        }
+        close(fd);
+        if (!success || 0 != rename(tmp_file.c_str(), filename.c_str()))
+        {
+            cout << "Could not write flow map lattice " << filename << endl;
+            unmap();
+            remove(tmp_file.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    //--------------------------------------------------------------------------//
+    optional<Vec3r> FlowMapLattice::eval(const Vec3r &pos, real t0, real tau) const
+    {
+        if (!mp_data)
+            return {};
+        size_t base[3];
+        real w[3];
+        for (size_t d = 0; d < 3; ++d)
+        {
+            real x = (pos[d] - m_min[d]) / m_cellSize[d];
+            if (x < 0.0 || x > real(m_dims[d]))
+                return {};
+            base[d] = min(size_t(x), m_dims[d] - 1);
+            w[d] = x - base[d];
+        }
+        size_t a, b;
+        real w_t0, w_tau;
+        if (!locate(m_t0s, t0, &a, &w_t0) || !locate(m_taus, tau, &b, &w_tau))
+            return {};
+
+        // 8 vertices x 4 nodes, weights of zero are skipped (e.g. on the nodes)
+        size_t num_taus = m_taus.size();
+        size_t num_nodes = m_t0s.size() * num_taus;
+        Vec3r result(0.0, 0.0, 0.0);
+        for (size_t c = 0; c < 8; ++c)
+        {
+            size_t i = base[0] + (c & 1), j = base[1] + ((c >> 1) & 1), k = base[2] + ((c >> 2) & 1);
+            real w_space = (c & 1 ? w[0] : 1.0 - w[0]) *
+                           ((c >> 1) & 1 ? w[1] : 1.0 - w[1]) *
+                           ((c >> 2) & 1 ? w[2] : 1.0 - w[2]);
+            if (w_space <= 0.0)
+                continue;
+            const float *p_vertex = mp_data + 3 * num_nodes * ((k * (m_dims[1] + 1) + j) * (m_dims[0] + 1) + i);
+            for (size_t n = 0; n < 4; ++n)
+            {
+                real weight = w_space * (n & 1 ? w_tau : 1.0 - w_tau) * (n & 2 ? w_t0 : 1.0 - w_t0);
+                if (weight <= 0.0)
+                    continue;
+                const float *p_end = p_vertex + 3 * ((a + (n >> 1)) * num_taus + b + (n & 1));
+                if (isnan(p_end[0]))
+                    return {};
+                for (size_t d = 0; d < 3; ++d)
+                    result[d] += weight * p_end[d];
+            }
+        }
+        return result;
+    }
+
+    //--------------------------------------------------------------------------//
+    void FlowMapLattice::getVertexEnds(size_t i, size_t j, size_t k, vector<optional<Vec3r>> &ends) const
+    {
+        size_t num_nodes = m_t0s.size() * m_taus.size();
+        ends.assign(num_nodes, {});
+        if (!mp_data)
+            return;
+        const float *p_vertex = mp_data + 3 * num_nodes * ((k * (m_dims[1] + 1) + j) * (m_dims[0] + 1) + i);
+        for (size_t n = 0; n < num_nodes; ++n)
+            if (!isnan(p_vertex[3 * n]))
+                ends[n] = Vec3r(p_vertex[3 * n], p_vertex[3 * n + 1], p_vertex[3 * n + 2]);
+    }
+
+    //--------------------------------------------------------------------------//
+    real FlowMapLattice::getError(real tau) const
+    {
+        if (m_errors.empty())
+            return 0.0;
+        size_t b;
+        real weight;
+        if (!locate(m_taus, tau, &b, &weight))
+            return *max_element(m_errors.begin(), m_errors.end());
+        return max(m_errors[b], m_errors[b + 1]);
+    }
+
+    //--------------------------------------------------------------------------//
+    bool FlowMapLattice::locate(const vector<real> &nodes, real value, size_t *p_index, real *p_weight)
+    {
+        if (nodes.size() < 2 || value < nodes.front() || value > nodes.back())
+            return false;
+        size_t upper = upper_bound(nodes.begin(), nodes.end(), value) - nodes.begin();
+        *p_index = min(upper, nodes.size() - 1) - 1;
+        *p_weight = (value - nodes[*p_index]) / (nodes[*p_index + 1] - nodes[*p_index]);
+        return true;
+    }
+
+    //--------------------------------------------------------------------------//
+    FlowMapLattice::FileHeader FlowMapLattice::createHeader(const string &flowName,
+                                                            const SearchParams &search) const
+    {
+        FileHeader header;
+        memset(&header, 0, sizeof(FileHeader));
+        memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+        header.version = FILE_VERSION;
+        for (size_t d = 0; d < 3; ++d)
+        {
+            header.dims[d] = uint32_t(m_dims[d]);
+            header.bbox[2 * d] = m_min[d];
+            header.bbox[2 * d + 1] = m_min[d] + m_dims[d] * m_cellSize[d];
+        }
+        header.search[0] = search.t0_min;
+        header.search[1] = search.t0_max;
+        header.search[2] = search.tau_min;
+        header.search[3] = search.tau_max;
+        header.search[4] = search.dt;
+        strncpy(header.flow, flowName.c_str(), sizeof(header.flow) - 1);
+        header.num_nodes[0] = uint32_t(m_t0s.size());
+        header.num_nodes[1] = uint32_t(m_taus.size());
+        // the data starts at a page
+        header.data_offset = (sizeof(FileHeader) + m_taus.size() * sizeof(real) + 4095) / 4096 * 4096;
+        return header;
+    }
+
+    //--------------------------------------------------------------------------//
+    bool FlowMapLattice::map(const string &filename, const FileHeader &header)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        size_t size = header.data_offset + dataSize();
+        void *p_mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (MAP_FAILED == p_mapping)
+            return false;
+
+        mp_mapping = p_mapping;
+        m_mappingSize = size;
+        mp_data = reinterpret_cast<const float *>(static_cast<const char *>(p_mapping) + header.data_offset);
+        return true;
+    }
+
+    //--------------------------------------------------------------------------//
+    void FlowMapLattice::unmap()
+    {
+        if (mp_mapping)
+            munmap(mp_mapping, m_mappingSize);
+        mp_mapping = nullptr;
+        m_mappingSize = 0;
+        mp_data = nullptr;
+    }
+    //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
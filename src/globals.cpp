@@ -6,7 +6,12 @@ real Globals::EPS   = std::numeric_limits<double>::epsilon();
 real Globals::ZERO  = 1000 * Globals::EPS;
 real Globals::SMALL = 10000000 * Globals::EPS;
 
-real Globals::SEARCHPREC = 0.001;
+real Globals::SEARCHPREC           = 0.001;
+real Globals::NEWTON_MAXEXTENT     = 0.05;
+real Globals::NEWTON_TOLERANCE     = 0.0001;
+size_t Globals::NEWTON_MAXITER     = 8;
+size_t Globals::NEWTON_MAXATTEMPTS = 2;
+real Globals::JACOBIAN_FDSTEP      = 0.000001;
 
 real Globals::RAYBACKOFFSET_REFINEMENT     = 0.015;
 real Globals::RAYFOREOFFSET_SHADOWS        = 0.005;
@@ -23,4 +28,19 @@ real Globals::T0EQUAL       = 0.00005;
 real Globals::TAUEQUAL      = 0.00005;
 real Globals::TAUMIN        = 0.001;
 real Globals::DETMIN        = 0.000001;
-real Globals::RECPOINTEQUAL = 0.00005;
\ No newline at end of file
+real Globals::RECPOINTEQUAL = 0.00005;
+
+real Globals::FLOWMAP_CACHE_QUANTUM        = 0.000000001;
+size_t Globals::FLOWMAP_CACHE_MAXBYTES     = size_t(4) << 30; // 4 GiB
+real Globals::FLOWMAP_COMPACT_TOLERANCE    = 0.0000001;
+bool Globals::FLOWMAP_FLOAT_STORAGE        = false;
+size_t Globals::FLOWMAP_TILECACHE_MAXBYTES = size_t(256) << 20; // 256 MiB per thread
+real Globals::FLOWMAP_CHUNK_TAU            = 0.2;
+
+size_t Globals::RENDER_TILESIZE   = 8;
+real Globals::RENDER_PRIOR_MARGIN = 1.0;
+bool Globals::RENDER_RAYTASKS     = true;
+real Globals::LATTICE_MARGIN      = 2.0;
+
+size_t Globals::SHADOWMAP_RESOLUTION = 128;
+size_t Globals::SHADOWMAP_PCFRADIUS  = 1;
@@ -1,5 +1,11 @@
 #include "hyperline.hh"
 
+#include <algorithm>
+
+#include "Eigen/Dense"
+
+#include "flowmapcache.hh"
+
 using namespace std;
 
 //--------------------------------------------------------------------------//
@@ -50,6 +56,7 @@ namespace RS
   HyperLine::operator=(const HyperLine &line)
   {
     this->mp_flowSampler = line.mp_flowSampler;
+    this->mp_lattice = line.mp_lattice;
     this->m_pointA = line.m_pointA;
     this->m_pointB = line.m_pointB;
     this->m_hyperPointA = line.m_hyperPointA;
@@ -77,105 +84,42 @@ namespace RS
     // output container for the recirculation points
     std::list<RecPoint> recPoints;
 
-    // some infos and containers needed for the computation
-    real t0_a = t0_min;
-    real t0_b = std::min(t0_min + dt, t0_max);
-    Vec3r diffVec[8];
-
     shared_ptr<FlowMap3D> flowMaps[4];
 
-    // prepare an array with the needed flowmaps for the first loop
-    flowMaps[0] = m_hyperPointA.getFlowMap(t0_a, tau_max);
-    flowMaps[1] = m_hyperPointB.getFlowMap(t0_a, tau_max);
-    flowMaps[2] = flowMaps[0];
-    flowMaps[3] = flowMaps[1];
+    // the flow maps are only integrated as far as they are needed and extended
+    // while tau grows, so the first step only needs tau of the first cuboid
+    prefetchFlowMaps(t0_min, t0_max, dt, firstTau(tau_min, tau_max, dt));
 
-    // loop over the possible t0
-    while (t0_a < t0_max)
+    // loop over the possible t0 and tau
+    for (const RecursiveSearchParams &param :
+         getSearchCells(t0_min, t0_max, tau_min, tau_max, dt, prec))
     {
-      // in each loop we use two old maps and need two new ones
-      flowMaps[0] = flowMaps[2];
-      flowMaps[1] = flowMaps[3];
-      flowMaps[2] = m_hyperPointA.getFlowMap(t0_b, tau_max);
-      flowMaps[3] = m_hyperPointB.getFlowMap(t0_b, tau_max);
-
-      real tau_a = tau_min; // tau must not be 0.0
-      real tau_b = std::min(tau_min + dt, tau_max);
+      if (!passesLatticeTest(param))
+        continue;
+      getCellFlowMaps(param.t0_a, param.t0_b, param.tau_b, flowMaps);
+      auto tempRecPoints = searchCell(param, flowMaps, p_stopProcess);
 
-      // loop over tau
-      while (tau_a < tau_max)
+      // insert the found RecPoints for the current t0/tau combination
+      if (0 < tempRecPoints.size())
       {
-        // tau_a and tau_b must not be 0.0
-        if (abs(tau_a) < Globals::TAUMIN)
-          tau_a = std::copysign(Globals::TAUMIN, tau_a);
-        if (abs(tau_b) < Globals::TAUMIN)
-          tau_b = std::copysign(Globals::TAUMIN, tau_b);
-        if (Globals::ZERO > abs(tau_b - tau_a))
-          break;
-
-        // Check one of the points is OutOfDomain.
-        if (false ==
-            getDiffVector(
-                &diffVec[0], &flowMaps[0], m_pointA, m_pointB, tau_a, tau_b))
-        {
-          tau_a = tau_b;
-          tau_b = std::min(tau_b + dt, tau_max);
-          continue;
-        }
-        // compute the scaling for this cube
-        real scale[3];
-        scale[0] = abs(tau_b - tau_a);
-        scale[1] = (m_pointA - m_pointB).norm2();
-        scale[2] = abs(t0_b - t0_a);
-        // check if the eight corresponding points have possible RecPoint in them
-        VectorCuboid checkCube(&diffVec[0], &scale[0]);
-        RecursiveSearchParams param(
-            t0_a, t0_b, tau_a, tau_b, m_pointA, m_pointB, prec);
-        if (checkCube.passesSignTest())
-        {
-          // start the recursive search to find the RecPoints
-          auto tempRecPoints = std::list<RecPoint>();
-          /**We have two possibilties recursive or iterative search.**/
-          /* 1. recursive search*/
-          //  tempRecPoints = searchRecPointSampling(param, &flowMaps[0],
-          //     Globals::SPACEEQUAL, 0, p_stopProcess);
-
-          /* 2. iterative search */
-          tempRecPoints = searchRecPointSamplingIter(
-              param, flowMaps, Globals::SPACEEQUAL, p_stopProcess);
-
-          // insert the found RecPoints for the current t0/tau combination
-          if (0 < tempRecPoints.size())
-          {
-            if (nullptr != p_candidates)
-              (*p_candidates)
-                  .insert(p_candidates->end(),
-                          tempRecPoints.begin(),
-                          tempRecPoints.end());
-            // assumption: a line hits only one point
-            // -> for a (t0, tau)-combination, we pick the point,
-            // with the best recirculation properties
-            RecPoint &bestPnt = tempRecPoints.front();
-            for (auto &tempPnt : tempRecPoints)
-              if (tempPnt.dist < bestPnt.dist)
-                bestPnt = tempPnt;
-            recPoints.push_back(bestPnt);
-          }
-        }
-        // if the process got killed for this line, return the current found
-        // points
-        if (p_stopProcess && 0 != *p_stopProcess)
-        {
-          std::vector<RecPoint> recPointsVec;
-          recPointsVec.insert(
-              recPointsVec.begin(), recPoints.begin(), recPoints.end());
-          return recPointsVec;
-        }
-        tau_a = tau_b;
-        tau_b = std::min(tau_b + dt, tau_max);
+        if (nullptr != p_candidates)
+          (*p_candidates)
+              .insert(p_candidates->end(),
+                      tempRecPoints.begin(),
+                      tempRecPoints.end());
+        // assumption: a line hits only one point
+        // -> for a (t0, tau)-combination, we pick the point,
+        // with the best recirculation properties
+        RecPoint &bestPnt = tempRecPoints.front();
+        for (auto &tempPnt : tempRecPoints)
+          if (tempPnt.dist < bestPnt.dist)
+            bestPnt = tempPnt;
+        recPoints.push_back(bestPnt);
       }
-      t0_a = t0_b;
-      t0_b = std::min(t0_b + dt, t0_max);
+      // if the process got killed for this line, return the current found
+      // points
+      if (p_stopProcess && 0 != *p_stopProcess)
+        break;
     }
     // convert the fast map to a vector
     std::vector<RecPoint> recPointsVec;
@@ -183,6 +127,8 @@ namespace RS
 
     return recPointsVec;
   }
+
+  //--------------------------------------------------------------------------//
   std::vector<RecPoint>
   HyperLine::getRecirculationPoints(const SearchParams &search,
                                     const bool &refine,
@@ -201,6 +147,268 @@ namespace RS
         p_stopProcess);
   }
 
+  //--------------------------------------------------------------------------//
+  bool
+  HyperLine::acceptByDistance(const RecPoint &point)
+  {
+    return point.dist < Globals::SPACEEQUAL;
+  }
+
+  //--------------------------------------------------------------------------//
+  /**Searches the (t0, tau)-cells one after another and stops as soon as the
+  best RecPoint of a cell is accepted by \c accept. Without \c window, the
+  cells are visited in the order of getRecirculationPoints. With a window (e.g.
+  from the RecPoints of neighbouring pixels), the cells overlapping it are
+  searched first, starting at its center. Only on a miss, the search goes on
+  with the remaining cells sorted by their distance to the window, so on a
+  coherent surface most of the sweep is skipped.
+  \param p_candidates - if given, gets the best point of each searched cell,
+                        which was not accepted
+  \return The first accepted RecPoint, if there is one.*/
+  std::optional<RecPoint>
+  HyperLine::getFirstRecirculationPoint(const SearchParams &search,
+                                        const AcceptancePredicate &accept,
+                                        const std::optional<SearchWindow> &window,
+                                        std::vector<RecPoint> *p_candidates,
+                                        int *p_stopProcess)
+  {
+    m_refine = false;
+
+    std::vector<RecursiveSearchParams> cells = getSearchCells(
+        search.t0_min, search.t0_max, search.tau_min, search.tau_max, search.dt, search.prec);
+
+    if (window.has_value())
+    {
+      // distance between a cell and a range in its larger dimension (0.0 if they overlap)
+      auto cellDist = [](const RecursiveSearchParams &cell, const Range &t0, const Range &tau) {
+        real d_t0 = std::max({cell.t0_a - t0.max, t0.min - cell.t0_b, 0.0});
+        real d_tau = std::max({cell.tau_a - tau.max, tau.min - cell.tau_b, 0.0});
+        return std::max(d_t0, d_tau);
+      };
+      real t0_mid = (window->t0.min + window->t0.max) / 2.0;
+      real tau_mid = (window->tau.min + window->tau.max) / 2.0;
+      Range t0_center(t0_mid, t0_mid), tau_center(tau_mid, tau_mid);
+      std::vector<std::pair<std::pair<real, real>, size_t>> order;
+      for (size_t i = 0; i < cells.size(); ++i)
+        order.push_back({{cellDist(cells[i], window->t0, window->tau),
+                          cellDist(cells[i], t0_center, tau_center)},
+                         i});
+      std::sort(order.begin(), order.end()); // the index keeps the sweep order for ties
+      std::vector<RecursiveSearchParams> sorted;
+      sorted.reserve(cells.size());
+      for (auto &o : order)
+        sorted.push_back(cells[o.second]);
+      cells.swap(sorted);
+    }
+    else
+      // the sweep visits all columns with small tau first
+      prefetchFlowMaps(search.t0_min, search.t0_max, search.dt,
+                       firstTau(search.tau_min, search.tau_max, search.dt));
+
+    shared_ptr<FlowMap3D> flowMaps[4];
+    for (const RecursiveSearchParams &param : cells)
+    {
+      if (!passesLatticeTest(param))
+        continue;
+      getCellFlowMaps(param.t0_a, param.t0_b, param.tau_b, flowMaps);
+      auto tempRecPoints = searchCell(param, flowMaps, p_stopProcess);
+      if (0 < tempRecPoints.size())
+      {
+        RecPoint &bestPnt = tempRecPoints.front();
+        for (auto &tempPnt : tempRecPoints)
+          if (tempPnt.dist < bestPnt.dist)
+            bestPnt = tempPnt;
+        if (accept(bestPnt))
+          return bestPnt;
+        if (nullptr != p_candidates)
+          p_candidates->push_back(bestPnt);
+      }
+      if (p_stopProcess && 0 != *p_stopProcess)
+        break;
+    }
+    return {};
+  }
+
+  //--------------------------------------------------------------------------//
+  /**Returns the search cells in the order of the sweep: t0 in the outer, tau in
+  the inner loop. tau is clamped to Globals::TAUMIN, cells which collapse by
+  this are skipped.*/
+  std::vector<HyperLine::RecursiveSearchParams>
+  HyperLine::getSearchCells(const real &t0_min,
+                            const real &t0_max,
+                            const real &tau_min,
+                            const real &tau_max,
+                            const real &dt,
+                            const real &prec) const
+  {
+    std::vector<RecursiveSearchParams> cells;
+    real t0_a = t0_min;
+    real t0_b = std::min(t0_min + dt, t0_max);
+    // loop over the possible t0
+    while (t0_a < t0_max)
+    {
+      real tau_a = tau_min; // tau must not be 0.0
+      real tau_b = std::min(tau_min + dt, tau_max);
+
+      // loop over tau
+      while (tau_a < tau_max)
+      {
+        // tau_a and tau_b must not be 0.0
+        if (abs(tau_a) < Globals::TAUMIN)
+          tau_a = std::copysign(Globals::TAUMIN, tau_a);
+        if (abs(tau_b) < Globals::TAUMIN)
+          tau_b = std::copysign(Globals::TAUMIN, tau_b);
+        if (Globals::ZERO > abs(tau_b - tau_a))
+          break;
+
+        cells.emplace_back(t0_a, t0_b, tau_a, tau_b, m_pointA, m_pointB, prec);
+        tau_a = tau_b;
+        tau_b = std::min(tau_b + dt, tau_max);
+      }
+      t0_a = t0_b;
+      t0_b = std::min(t0_b + dt, t0_max);
+    }
+    return cells;
+  }
+
+  //--------------------------------------------------------------------------//
+  /**Returns tau of the first cuboid of the sweep, clamped to Globals::TAUMIN.*/
+  real
+  HyperLine::firstTau(const real &tau_min, const real &tau_max, const real &dt)
+  {
+    real tau_first = std::min(tau_min + dt, tau_max);
+    if (abs(tau_first) < Globals::TAUMIN)
+      tau_first = std::copysign(Globals::TAUMIN, tau_first);
+    return tau_first;
+  }
+
+  //--------------------------------------------------------------------------//
+  /**Integrates the flow maps of both HyperPoints for all t0 steps together up
+  to \c tau.*/
+  void
+  HyperLine::prefetchFlowMaps(const real &t0_min,
+                              const real &t0_max,
+                              const real &dt,
+                              const real &tau)
+  {
+    std::vector<Vec3r> positions;
+    std::vector<real> t0s, taus;
+    for (real t0 = t0_min;; t0 = std::min(t0 + dt, t0_max))
+    {
+      positions.push_back(m_pointA);
+      positions.push_back(m_pointB);
+      t0s.insert(t0s.end(), 2, t0);
+      taus.insert(taus.end(), 2, tau);
+      if (t0 >= t0_max)
+        break;
+    }
+    std::vector<shared_ptr<FlowMap3D>> columnMaps(positions.size());
+    sampleFlowMaps(
+        positions.size(), positions.data(), t0s.data(), taus.data(), columnMaps.data());
+    for (size_t i = 0; i < columnMaps.size(); i += 2)
+    {
+      m_hyperPointA.addFlowMap(t0s[i], tau, columnMaps[i]);
+      m_hyperPointB.addFlowMap(t0s[i + 1], tau, columnMaps[i + 1]);
+    }
+  }
+
+  //--------------------------------------------------------------------------//
+  /**Provides the flow maps of the four corners of a cell (A and B at t0_a, A and
+  B at t0_b). If one of them does not reach tau_b, all four are extended
+  together.*/
+  void
+  HyperLine::getCellFlowMaps(const real &t0_a,
+                             const real &t0_b,
+                             const real &tau_b,
+                             std::shared_ptr<FlowMap3D> *p_flowMaps)
+  {
+    p_flowMaps[0] = m_hyperPointA.findFlowMap(t0_a, tau_b);
+    p_flowMaps[1] = m_hyperPointB.findFlowMap(t0_a, tau_b);
+    p_flowMaps[2] = m_hyperPointA.findFlowMap(t0_b, tau_b);
+    p_flowMaps[3] = m_hyperPointB.findFlowMap(t0_b, tau_b);
+    for (int i = 0; i < 4; ++i)
+    {
+      if (p_flowMaps[i] && p_flowMaps[i]->covers(tau_b))
+        continue;
+      Vec3r positions[4] = {m_pointA, m_pointB, m_pointA, m_pointB};
+      real t0s[4] = {t0_a, t0_a, t0_b, t0_b};
+      real taus[4] = {tau_b, tau_b, tau_b, tau_b};
+      sampleFlowMaps(4, positions, t0s, taus, p_flowMaps);
+      m_hyperPointA.addFlowMap(t0_a, tau_b, p_flowMaps[0]);
+      m_hyperPointB.addFlowMap(t0_a, tau_b, p_flowMaps[1]);
+      m_hyperPointA.addFlowMap(t0_b, tau_b, p_flowMaps[2]);
+      m_hyperPointB.addFlowMap(t0_b, tau_b, p_flowMaps[3]);
+      break;
+    }
+  }
+
+  //--------------------------------------------------------------------------//
+  /**The corners of the cells are nodes of the lattice in t0 and tau, so only
+  the spatial interpolation is approximated. Corners which are not covered by
+  the lattice make the test pass.*/
+  bool
+  HyperLine::passesLatticeTest(const RecursiveSearchParams &param) const
+  {
+    if (!mp_lattice)
+      return true;
+    real tolerance = Globals::LATTICE_MARGIN *
+                     std::max(mp_lattice->getError(param.tau_a), mp_lattice->getError(param.tau_b));
+    Vec3r diff_min(numeric_limits<real>::max(), numeric_limits<real>::max(), numeric_limits<real>::max());
+    Vec3r diff_max = -diff_min;
+    for (const Vec3r &point : {param.point_a, param.point_b})
+      for (real t0 : {param.t0_a, param.t0_b})
+        for (real tau : {param.tau_a, param.tau_b})
+        {
+          std::optional<Vec3r> end = mp_lattice->eval(point, t0, tau);
+          if (!end)
+            return true;
+          for (int i = 0; i < 3; ++i)
+          {
+            diff_min[i] = std::min(diff_min[i], point[i] - (*end)[i]);
+            diff_max[i] = std::max(diff_max[i], point[i] - (*end)[i]);
+          }
+        }
+    for (int i = 0; i < 3; ++i)
+      if (diff_min[i] > tolerance || diff_max[i] < -tolerance)
+        return false;
+    return true;
+  }
+
+  //--------------------------------------------------------------------------//
+  /**Searches the RecPoints of a single (t0, tau)-cell, if it passes the sign
+  test.*/
+  std::list<RecPoint>
+  HyperLine::searchCell(const RecursiveSearchParams &param,
+                        const std::shared_ptr<FlowMap3D> *p_flowMaps,
+                        int *p_stopProcess)
+  {
+    Vec3r diffVec[8];
+    // Check one of the points is OutOfDomain.
+    if (false ==
+        getDiffVector(
+            &diffVec[0], p_flowMaps, param.point_a, param.point_b, param.tau_a, param.tau_b))
+      return {};
+    // compute the scaling for this cube
+    real scale[3];
+    scale[0] = abs(param.tau_b - param.tau_a);
+    scale[1] = (param.point_a - param.point_b).norm2();
+    scale[2] = abs(param.t0_b - param.t0_a);
+    // check if the eight corresponding points have possible RecPoint in them
+    VectorCuboid checkCube(&diffVec[0], &scale[0]);
+    if (!checkCube.passesSignTest())
+      return {};
+
+    // start the recursive search to find the RecPoints
+    /**We have two possibilties recursive or iterative search.**/
+    /* 1. recursive search*/
+    //  return searchRecPointSampling(param, p_flowMaps,
+    //     Globals::SPACEEQUAL, 0, p_stopProcess);
+
+    /* 2. iterative search */
+    return searchRecPointSamplingIter(
+        param, p_flowMaps, Globals::SPACEEQUAL, p_stopProcess);
+  }
+
   //--------------------------------------------------------------------------//
   /**Does a recursive subdivision of the search space, that is defined by \c param
   to find critical points / recirculation points. When this method is called and
@@ -289,7 +497,10 @@ namespace RS
 
   //--------------------------------------------------------------------------//
   /**This is the iterative version of the search method. The areas in which the
-   (prefered) search takes place are managed by lists.  */
+   search takes place are managed by a best-first SearchFrontier: areas in which
+   the trilinear search found a point are refined first, all others in the order
+   of their residual. The frontier is a member, so its storage is reused for all
+   cells of the HyperLine.  */
   std::list<RecPoint>
   HyperLine::searchRecPointSamplingIter(
       const RecursiveSearchParams &params,
@@ -298,146 +509,228 @@ namespace RS
       int *p_stopProcess)
   {
     list<RecPoint> recPoints;
-    // create a list with all octants that should be searched
-    list<SearchPair> searchList;
 
     // put in the first entry, that gets searched
-    vector<shared_ptr<FlowMap3D>> flowMaps4;
+    m_frontier.clear();
+    Frontier::Slot slots[4];
     for (int i = 0; i < 4; i++)
-      flowMaps4.push_back(p_flowMaps[i]);
-    auto entry = std::make_pair(params, flowMaps4);
-    searchList.push_back(entry);
+      slots[i] = m_frontier.addFlowMap(p_flowMaps[i]);
+    m_frontier.push(params, slots, true, 0, 0.0);
 
     // criteria to stop the search process
     unsigned int stepCount = 0;
     // unsigned int maxSteps = static_cast<int>(pow(8, 8));
     // unsigned int maxSteps = static_cast<int>(pow(8, 4));
     unsigned int maxSteps = 512;
-    bool goOn = true;
-
-    vector<shared_ptr<FlowMap3D>> flowMaps;
-
-    // remind the old front element, to check if the trilinear search found a
-    // RecPoint if so, the front element will change
-    auto oldFront = searchList.front().first;
+    size_t newtonAttempts = 0;
 
     // do a search over all elements
-    while (goOn)
+    while (!m_frontier.empty() && !(p_stopProcess && (0 != *p_stopProcess)) &&
+           (stepCount < maxSteps))
     {
       // get the next element
-      auto entry =
-          std::make_pair(searchList.front().first, searchList.front().second);
-      searchList.pop_front();
+      Frontier::Node node = m_frontier.pop();
 
+      std::optional<RecPoint> rcp;
       // check if we reached the wanted accuracy
-      if (reachedSamplingAccuracy(entry.first))
+      if (reachedSamplingAccuracy(node.params))
       {
         // if so average the point from the available infos and return it
-        real t0_avg = (entry.first.t0_a + entry.first.t0_b) / 2.0;
-        real tau_avg = (entry.first.tau_a + entry.first.tau_b) / 2.0;
-        Vec3r point_avg = (entry.first.point_a + entry.first.point_b) / 2.0;
-        auto rcp = createRecPoint(point_avg, t0_avg, tau_avg);
-        // cout << "found point. step count: " << stepCount << "\n";
-        if (reqDist < 0 || reqDist < rcp.dist)
-          recPoints.push_back(rcp);
+        real t0_avg = (node.params.t0_a + node.params.t0_b) / 2.0;
+        real tau_avg = (node.params.tau_a + node.params.tau_b) / 2.0;
+        Vec3r point_avg = (node.params.point_a + node.params.point_b) / 2.0;
+        rcp = createRecPoint(point_avg, t0_avg, tau_avg);
+      }
+      // a small area with a point found by the trilinear search is refined by
+      // Newton's method, which needs less integrations than the subdivision
+      else if (node.preferred && newtonAttempts < Globals::NEWTON_MAXATTEMPTS &&
+               fitsNewtonExtent(node.params))
+      {
+        ++newtonAttempts;
+        rcp = refineRecPointNewton(node.params);
+      }
+      if (rcp.has_value())
+      {
+        m_frontier.release(node);
+        if (reqDist < 0 || reqDist < rcp->dist)
+          recPoints.push_back(*rcp);
         else
         {
-          recPoints.push_front(rcp);
-          // cout << "found point. Steps needed:     " << stepCount << "\n";
+          recPoints.push_front(*rcp);
+          m_frontier.clear();
           return recPoints;
         }
+        continue;
       }
 
-      // remind the front element to check if trilinear search found a RecPoint
-      if (!searchList.empty())
-        oldFront = searchList.front().first;
-
-      // if not resample the search space for this cube
-      vector<shared_ptr<FlowMap3D>> subFlowMaps;
-      subFlowMaps.resize(9);
-      resampleCuboid(entry, subFlowMaps, &searchList);
-
-      // check if the front element has changed, if so a prefered octant was
-      // found if not we searched an area, where it is likely that there is no
+      // if not resample the search space for this cube; if no prefered octant
+      // was found, we searched an area, where it is likely that there is no
       // point
-      if (!searchList.empty() && oldFront == searchList.front().first)
-      {
+      if (!resampleCuboid(node) && !m_frontier.empty())
         stepCount++;
-      }
-
-      // copy references to keep flowmaps alive
-      for (auto fm : subFlowMaps)
-        if (fm)
-          flowMaps.push_back(fm);
-
-      // and go on
-      goOn = !searchList.empty() && !(p_stopProcess && (0 != *p_stopProcess)) &&
-             (stepCount < maxSteps);
     }
     // if (stepCount >= maxSteps)
     //   cout << "not found: " << stepCount << " stopped with maximum steps.\n";
     if (p_stopProcess && (0 != *p_stopProcess))
       cout << "not found: " << stepCount << " stopped by kill. " << *p_stopProcess
            << "\n";
+    m_frontier.clear();
     return recPoints;
   }
 
   //--------------------------------------------------------------------------//
-  void
-  HyperLine::resampleCuboid(const SearchPair &searchSpace,
-                            vector<shared_ptr<FlowMap3D>> &subFlowMaps,
-                            list<SearchPair> *p_searchList)
+  bool
+  HyperLine::fitsNewtonExtent(const RecursiveSearchParams &params) const
   {
-    const RecursiveSearchParams &params = searchSpace.first;
-    const std::shared_ptr<FlowMap3D> p_flowMaps = searchSpace.second[0];
-
-    // real t0_a = params.t0_a;
-    // real t0_b = params.t0_b;
-    // real t0_avg = (t0_a + t0_b) / 2.0;
-    // real tau_a = params.tau_a;
-    // real tau_b = params.tau_b;
-    // real tau_avg = (tau_a + tau_b) / 2.0;
-    Vec3r point_a = params.point_a;
-    Vec3r point_b = params.point_b;
-    Vec3r point_avg = (point_a + point_b) / 2.0;
+    return (params.point_b - params.point_a).norm() <= Globals::NEWTON_MAXEXTENT &&
+           abs(params.t0_b - params.t0_a) <= Globals::NEWTON_MAXEXTENT &&
+           abs(params.tau_b - params.tau_a) <= Globals::NEWTON_MAXEXTENT;
+  }
 
-    // check if we reached the wanted accuracy
-    bool space = false;
-    bool time = false;
-    if (reachedSamplingAccuracy(params, &time, &space))
-      return;
+  //--------------------------------------------------------------------------//
+  /**Solves phi(x, t0, tau) - x = 0 for the position x on the segment, t0 and tau
+  by Newton's method (Gauss-Newton, if the Jacobian is singular). The Jacobian
+  is taken from the variational equations, so each iteration needs a single
+  integration. The search starts in the center of the area.
+  \return The RecPoint, if the iteration converged inside the area (else the
+  point is left to the subdivision).*/
+  std::optional<RecPoint>
+  HyperLine::refineRecPointNewton(const RecursiveSearchParams &params) const
+  {
+    Vec3r dir = params.point_b - params.point_a;
+    real length = dir.norm();
+    if (length > Globals::ZERO)
+      dir = dir / length;
+    const real &prec = params.prec;
+
+    // unknowns: position on the segment (as distance to point_a), t0 and tau
+    Eigen::Vector3d u(length / 2.0,
+                      (params.t0_a + params.t0_b) / 2.0,
+                      (params.tau_a + params.tau_b) / 2.0);
+    for (size_t iter = 0; iter < Globals::NEWTON_MAXITER; ++iter)
+    {
+      Vec3r f;
+      Derivative dF;
+      if (!evalResidual(*mp_flowSampler, params.point_a + dir * u[0], u[1], u[2], &f, &dF))
+        return {};
+      // chain rule for the position on the segment
+      Eigen::Matrix3d jacobian;
+      jacobian.col(0) = dF.leftCols<3>() * Eigen::Vector3d(dir[0], dir[1], dir[2]);
+      jacobian.rightCols<2>() = dF.rightCols<2>();
+      Eigen::Vector3d du =
+          jacobian.colPivHouseholderQr().solve(Eigen::Vector3d(-f[0], -f[1], -f[2]));
+      u += du;
+
+      // the point has to stay in the area, else it belongs to another one
+      if (u[0] < -prec || u[0] > length + prec ||
+          u[1] < params.t0_a - prec || u[1] > params.t0_b + prec ||
+          u[2] < params.tau_a - prec || u[2] > params.tau_b + prec)
+        return {};
+      if (du.lpNorm<Eigen::Infinity>() < prec * Globals::NEWTON_TOLERANCE)
+        return createRecPoint(params.point_a + dir * std::clamp(u[0], 0.0, length),
+                              std::clamp(u[1], params.t0_a, params.t0_b),
+                              std::clamp(u[2], params.tau_a, params.tau_b));
+    }
+    return {};
+  }
+
+  //--------------------------------------------------------------------------//
+  /**The derivative is
+  [dF/dx | dF/dt0 | dF/dtau] = [G - I | v(phi, t0 + tau) - G v(pos, t0) | v(phi, t0 + tau)]
+  with the gradient G of the flow map, which is integrated along the pathline.*/
+  bool
+  HyperLine::evalResidual(FlowSampler3D &sampler,
+                          const Vec3r &pos,
+                          const real &t0,
+                          const real &tau,
+                          Vec3r *p_residual,
+                          Derivative *p_derivative)
+  {
+    Vec3r end;
+    Flow3D::Gradient gradient;
+    auto state = sampler.sampleFlowGradient(pos, t0, tau, &end, &gradient);
+    if (VC::math::ode::EvalState::Success != state)
+      return false;
+    *p_residual = end - pos;
+    if (p_derivative)
+    {
+      const auto &flow = sampler.getFlow();
+      Vec3r v_end = flow.v(t0 + tau, end);
+      Vec3r v_start = flow.v(t0, pos);
+      Eigen::Vector3d dTau(v_end[0], v_end[1], v_end[2]);
+      p_derivative->leftCols<3>() = gradient - Eigen::Matrix3d::Identity();
+      p_derivative->col(3) = dTau - gradient * Eigen::Vector3d(v_start[0], v_start[1], v_start[2]);
+      p_derivative->col(4) = dTau;
+    }
+    return true;
+  }
+
+  //--------------------------------------------------------------------------//
+  /**Subdivides the area of \c node and pushes the octants which should be
+  searched into the frontier. The flow maps of \c node are released afterwards.
+  \return true, if a prefered octant was found.*/
+  bool
+  HyperLine::resampleCuboid(const Frontier::Node &node)
+  {
+    const RecursiveSearchParams &params = node.params;
 
     // do a further resampling of the searchspace
     auto subPara = std::vector<RecursiveSearchParams>();
     auto mapIndi = std::vector<std::vector<int>>();
 
+    std::shared_ptr<FlowMap3D> flowMaps[4];
+    for (int i = 0; i < 4; i++)
+      flowMaps[i] = m_frontier.flowMap(node.maps[i]);
+
+    bool space = false;
+    bool time = false;
+    reachedSamplingAccuracy(params, &time, &space);
+    std::shared_ptr<FlowMap3D> subFlowMaps[9];
     refineSearchSpace(params,
                       !space,
                       !time,
-                      &searchSpace.second[0],
+                      &flowMaps[0],
                       &subFlowMaps[0],
                       &subPara,
                       &mapIndi);
 
     // estimate a good search order for the octants
+    real residuals[8];
     std::list<std::pair<int, bool>> octants =
-        computePreferedOctants(&subFlowMaps[0], &subPara, &mapIndi);
+        computePreferedOctants(&subFlowMaps[0], &subPara, &mapIndi, residuals);
+
+    // the sub flow maps get slots in the frontier (the ones of the parent are
+    // reused)
+    Frontier::Slot subSlots[9];
+    for (int k = 0; k < 9; k++)
+    {
+      if (!subFlowMaps[k])
+        continue;
+      int parent = std::find(flowMaps, flowMaps + 4, subFlowMaps[k]) - flowMaps;
+      subSlots[k] = parent < 4 ? node.maps[parent] : m_frontier.addFlowMap(subFlowMaps[k]);
+    }
 
-    // place the octants into the search list according to their preference
-    vector<shared_ptr<FlowMap3D>> subMaps;
-    subMaps.resize(4);
+    // place the octants into the frontier according to their preference
+    bool prefered = false;
     for (auto &octant : octants)
     {
-      subMaps[0] = subFlowMaps[mapIndi[octant.first][0]];
-      subMaps[1] = subFlowMaps[mapIndi[octant.first][1]];
-      subMaps[2] = subFlowMaps[mapIndi[octant.first][2]];
-      subMaps[3] = subFlowMaps[mapIndi[octant.first][3]];
-
-      if (octant.second)
-        p_searchList->push_front(std::make_pair(subPara[octant.first], subMaps));
-      else if (!m_refine)
-        p_searchList->push_back(std::make_pair(subPara[octant.first], subMaps));
+      if (!octant.second && m_refine)
+        continue;
+      Frontier::Slot slots[4] = {subSlots[mapIndi[octant.first][0]],
+                                 subSlots[mapIndi[octant.first][1]],
+                                 subSlots[mapIndi[octant.first][2]],
+                                 subSlots[mapIndi[octant.first][3]]};
+      m_frontier.push(subPara[octant.first], slots, octant.second, node.level + 1,
+                      residuals[octant.first]);
+      prefered |= octant.second;
     }
+
+    // free the flow maps which are not needed anymore
+    m_frontier.release(node);
+    for (int k = 0; k < 9; k++)
+      if (subFlowMaps[k])
+        m_frontier.collect(subSlots[k]);
+    return prefered;
   }
 
   //--------------------------------------------------------------------------//
@@ -480,14 +773,10 @@ belong to the parameters of the subspaces
       // there are 9 new flowMaps that need to be computed
       for (int i = 0; i < 4; i++)
         p_subFlowMaps[i] = p_flowMaps[i];
-      for (int i = 4; i < 9; i++)
-        p_subFlowMaps[i] = make_shared<FlowMap3D>();
-      mp_flowSampler->sampleFlow(p_subFlowMaps[4].get(), point_avg, t0_a, tau_b);
-      mp_flowSampler->sampleFlow(p_subFlowMaps[5].get(), point_a, t0_avg, tau_b);
-      mp_flowSampler->sampleFlow(
-          p_subFlowMaps[6].get(), point_avg, t0_avg, tau_b);
-      mp_flowSampler->sampleFlow(p_subFlowMaps[7].get(), point_b, t0_avg, tau_b);
-      mp_flowSampler->sampleFlow(p_subFlowMaps[8].get(), point_avg, t0_b, tau_b);
+      Vec3r positions[5] = {point_avg, point_a, point_avg, point_b, point_avg};
+      real t0s[5] = {t0_a, t0_avg, t0_avg, t0_avg, t0_b};
+      real taus[5] = {tau_b, tau_b, tau_b, tau_b, tau_b};
+      sampleFlowMaps(5, positions, t0s, taus, &p_subFlowMaps[4]);
 
       // prepare two vectors with time info and FlowMap indices for the next
       // subdivision step
@@ -520,13 +809,17 @@ belong to the parameters of the subspaces
     // refine time only
     if (!refineSpace && refineTime)
     {
-      // there are 9 new flowMaps that need to be computed
+      // there are 2 new flowMaps that need to be computed, the other entries
+      // stay empty
       for (int i = 0; i < 4; i++)
         p_subFlowMaps[i] = p_flowMaps[i];
-      for (int i = 4; i < 9; i++)
-        p_subFlowMaps[i] = make_shared<FlowMap3D>();
-      mp_flowSampler->sampleFlow(p_subFlowMaps[5].get(), point_a, t0_avg, tau_b);
-      mp_flowSampler->sampleFlow(p_subFlowMaps[7].get(), point_b, t0_avg, tau_b);
+      Vec3r positions[2] = {point_a, point_b};
+      real t0s[2] = {t0_avg, t0_avg};
+      real taus[2] = {tau_b, tau_b};
+      shared_ptr<FlowMap3D> flowMaps[2];
+      sampleFlowMaps(2, positions, t0s, taus, flowMaps);
+      p_subFlowMaps[5] = flowMaps[0];
+      p_subFlowMaps[7] = flowMaps[1];
 
       // prepare two vectors with time info and FlowMap indices for the next
       // subdivision step
@@ -547,13 +840,17 @@ belong to the parameters of the subspaces
     // refine space only
     if (refineSpace && !refineTime)
     {
-      // there are 9 new flowMaps that need to be computed
+      // there are 2 new flowMaps that need to be computed, the other entries
+      // stay empty
       for (int i = 0; i < 4; i++)
         p_subFlowMaps[i] = p_flowMaps[i];
-      for (int i = 4; i < 9; i++)
-        p_subFlowMaps[i] = make_shared<FlowMap3D>();
-      mp_flowSampler->sampleFlow(p_subFlowMaps[4].get(), point_avg, t0_a, tau_b);
-      mp_flowSampler->sampleFlow(p_subFlowMaps[8].get(), point_avg, t0_b, tau_b);
+      Vec3r positions[2] = {point_avg, point_avg};
+      real t0s[2] = {t0_a, t0_b};
+      real taus[2] = {tau_b, tau_b};
+      shared_ptr<FlowMap3D> flowMaps[2];
+      sampleFlowMaps(2, positions, t0s, taus, flowMaps);
+      p_subFlowMaps[4] = flowMaps[0];
+      p_subFlowMaps[8] = flowMaps[1];
 
       // prepare two vectors with time info and FlowMap indices for the next
       // subdivision step
@@ -566,19 +863,38 @@ belong to the parameters of the subspaces
     }
   }
 
+  //--------------------------------------------------------------------------//
+  /**Returns the flow maps for the given seeds. They are taken from the shared
+  FlowMapCache, so flow maps of other rays and earlier phases are reused. The
+  missing ones are integrated together by a BatchFlowSampler3D.*/
+  void
+  HyperLine::sampleFlowMaps(size_t count,
+                            const Vec3r *p_positions,
+                            const real *p_t0,
+                            const real *p_tau,
+                            std::shared_ptr<FlowMap3D> *p_flowMaps) const
+  {
+    BatchFlowSampler3D sampler(mp_flowSampler->getFlow());
+    FlowMapCache::instance().getFlowMaps(
+        sampler, count, p_positions, p_t0, p_tau, p_flowMaps);
+  }
+
   //--------------------------------------------------------------------------//
   /***Gets a octant which should be searched for RecPoints. The check is done by a
 trilinear search. If this search reveals, there is a point, this octant will be
 prefered for the search. If there is no point in there, this octant will not be
 prefered. If there is an extended critical structure, this octant will be
 skipped.
+\param [out] p_residuals - optional - smallest distance between seed and end
+       position of the corners for each octant
 \return A list, which contains the octants, that will be searched and a
         flag indicating if it should be prefered (true) or not (false).*/
   std::list<std::pair<int, bool>>
   HyperLine::computePreferedOctants(
       std::shared_ptr<FlowMap3D> *p_subFlowMaps,
       std::vector<RecursiveSearchParams> *p_subParams,
-      std::vector<std::vector<int>> *p_mapIndexes) const
+      std::vector<std::vector<int>> *p_mapIndexes,
+      real *p_residuals) const
   {
     std::list<std::pair<int, bool>> octants;
     int i = -1;
@@ -597,9 +913,15 @@ skipped.
           getDiffVector(
               &diffVec[0], &subMaps[0], sp.point_a, sp.point_b, sp.tau_a, sp.tau_b))
         continue;
+      if (p_residuals)
+      {
+        p_residuals[i] = diffVec[0].norm();
+        for (int k = 1; k < 8; k++)
+          p_residuals[i] = std::min(p_residuals[i], diffVec[k].norm());
+      }
       real scale[3];
       scale[0] = abs(sp.tau_b - sp.tau_a);
-      scale[1] = abs(subMaps[2]->t.front() - subMaps[0]->t.front());
+      scale[1] = abs(subMaps[2]->startTime() - subMaps[0]->startTime());
       scale[2] = (sp.point_a - sp.point_b).norm2();
       VectorCuboid checkCube(&diffVec[0], &scale[0]);
 
@@ -672,10 +994,10 @@ Condition 2: A particle, must reach different positions for different t0/tau
                            const real &tau_a,
                            const real &tau_b) const
   {
-    /*!**************************!*/
-    /*! p_flowMaps[0]->t.front() !*/
-    /*! equals the start time t0 !*/
-    /*!**************************!*/
+    /*!*********************************!*/
+    /*! p_flowMaps[0]->startTime()      !*/
+    /*! equals the start time t0        !*/
+    /*!*********************************!*/
 
     // check if one of the points is out of domain
     // if the particle hits the boundary or a critcal point, it is not integrated
@@ -683,22 +1005,21 @@ Condition 2: A particle, must reach different positions for different t0/tau
     // asked for or the flowmapis empty at all
     for (int i = 0; i < 4; i++)
     {
-      if (p_flowMaps[i]->t.size() == 0)
+      if (p_flowMaps[i]->empty())
         return false;
-      if (p_flowMaps[i]->t.back() < p_flowMaps[i]->t.front() + tau_a ||
-          p_flowMaps[i]->t.back() < p_flowMaps[i]->t.front() + tau_b)
+      if (!p_flowMaps[i]->reaches(tau_a) || !p_flowMaps[i]->reaches(tau_b))
         return false;
     }
 
     Vec3r advPos[8]; // particle positions after some advection
-    advPos[0] = p_flowMaps[0]->eval_position_at(p_flowMaps[0]->t.front() + tau_a);
-    advPos[1] = p_flowMaps[0]->eval_position_at(p_flowMaps[0]->t.front() + tau_b);
-    advPos[2] = p_flowMaps[1]->eval_position_at(p_flowMaps[1]->t.front() + tau_b);
-    advPos[3] = p_flowMaps[1]->eval_position_at(p_flowMaps[1]->t.front() + tau_a);
-    advPos[4] = p_flowMaps[2]->eval_position_at(p_flowMaps[2]->t.front() + tau_a);
-    advPos[5] = p_flowMaps[2]->eval_position_at(p_flowMaps[2]->t.front() + tau_b);
-    advPos[6] = p_flowMaps[3]->eval_position_at(p_flowMaps[3]->t.front() + tau_b);
-    advPos[7] = p_flowMaps[3]->eval_position_at(p_flowMaps[3]->t.front() + tau_a);
+    advPos[0] = p_flowMaps[0]->eval_position_at(p_flowMaps[0]->startTime() + tau_a);
+    advPos[1] = p_flowMaps[0]->eval_position_at(p_flowMaps[0]->startTime() + tau_b);
+    advPos[2] = p_flowMaps[1]->eval_position_at(p_flowMaps[1]->startTime() + tau_b);
+    advPos[3] = p_flowMaps[1]->eval_position_at(p_flowMaps[1]->startTime() + tau_a);
+    advPos[4] = p_flowMaps[2]->eval_position_at(p_flowMaps[2]->startTime() + tau_a);
+    advPos[5] = p_flowMaps[2]->eval_position_at(p_flowMaps[2]->startTime() + tau_b);
+    advPos[6] = p_flowMaps[3]->eval_position_at(p_flowMaps[3]->startTime() + tau_b);
+    advPos[7] = p_flowMaps[3]->eval_position_at(p_flowMaps[3]->startTime() + tau_a);
 
     diffVec[0] = point_a - advPos[0];
     diffVec[1] = point_a - advPos[1];
@@ -739,11 +1060,11 @@ Condition 2: A particle, must reach different positions for different t0/tau
                             const real &tau) const
   {
     // if so average the point from the available infos and return it
-    FlowMap3D flowMap = mp_flowSampler->sampleFlow(pos, t0, tau);
-    Vec3r endPoint = flowMap.y.back();
+    Pathline3D pathline = mp_flowSampler->sampleFlow(pos, t0, tau);
+    Vec3r endPoint = pathline.y.back();
     Vec3r n(0.0, 0.0, 0.0);
     Vec3r temp(0.0, 0.0, 0.0);
-    flowMap.eval_at(t0, temp, &n);
+    pathline.eval_at(t0, temp, &n);
     n.normalize();
     real dist = (endPoint - pos).norm2();
     RecPoint newPoint(pos, n, t0, tau, dist);
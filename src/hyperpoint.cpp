@@ -1,5 +1,7 @@
 #include "hyperpoint.hh"
 
+#include "flowmapcache.hh"
+
 using namespace std;
 
 //--------------------------------------------------------------------------//
@@ -55,30 +57,40 @@ namespace RS
   }
 
   //-----------------------------------------------------------------------------------------------//
-  /**Returns a flow map with the given t0 and tau. The flow map is integrated, if
-it was not computed previously.*/
+  /**Returns a flow map with the given t0, which covers at least tau. The flow
+map is taken from the shared FlowMapCache and only integrated (or extended), if
+it was not computed that far previously.*/
   const std::shared_ptr<FlowMap3D>
   HyperPoint::getFlowMap(const real &t0, const real &tau)
   {
     // check if the wanted flow map is already there
-    pair<real, real> timePair = make_pair(t0, tau);
-    if (m_flowMaps.find(timePair) != m_flowMaps.end())
-      return m_flowMaps[timePair];
+    pair<real, real> timePair = make_pair(t0, tau < 0.0 ? -1.0 : 1.0);
+    auto it = m_flowMaps.find(timePair);
+    if (it != m_flowMaps.end() && it->second->covers(tau))
+      return it->second;
 
-    // if it is not there, compute it
-    shared_ptr<FlowMap3D> flowMap = make_shared<FlowMap3D>();
-    mp_flowSampler->sampleFlow(flowMap.get(), m_pos, t0, tau);
+    // if it is not there, ask the shared cache (which computes it if needed)
+    shared_ptr<FlowMap3D> flowMap =
+        FlowMapCache::instance().getFlowMap(mp_flowSampler->getFlow(), m_pos, t0, tau);
     m_flowMaps[timePair] = flowMap;
     return flowMap;
   }
 
+  //--------------------------------------------------------------------------//
+  shared_ptr<FlowMap3D>
+  HyperPoint::findFlowMap(const real &t0, const real &tau) const
+  {
+    auto it = m_flowMaps.find(make_pair(t0, tau < 0.0 ? -1.0 : 1.0));
+    return it != m_flowMaps.end() ? it->second : nullptr;
+  }
+
   //-----------------------------------------------------------------------------------------------//
   void
   HyperPoint::addFlowMap(const real &t0,
                          const real &tau,
                          shared_ptr<FlowMap3D> flow_map)
   {
-    pair<real, real> timePair = make_pair(t0, tau);
+    pair<real, real> timePair = make_pair(t0, tau < 0.0 ? -1.0 : 1.0);
     m_flowMaps[timePair] = flow_map;
   }
   //--------------------------------------------------------------------------//
@@ -1,6 +1,7 @@
 #include <filesystem>
 #include <stdio.h>
 
+#include "flowmapcache.hh"
 #include "refraytracer.hh"
 #include "scenesetup.hh"
 #include "shader.hh"
@@ -38,6 +39,7 @@ basicRaytracing(shared_ptr<Scene> scene,
   timer.printTotalTime();
   // output of ratio and reset static timers
   TimerHandler::printRatio();
+  FlowMapCache::instance().printStats();
   TimerHandler::reset();
 
   printSeparator('=');
@@ -66,6 +68,7 @@ refiningRaytracing(const Raytracer *basic_rt,
   timer.printTotalTime();
   // output of ratio and reset static timers
   TimerHandler::printRatio();
+  FlowMapCache::instance().printStats();
   TimerHandler::reset();
 
   printSeparator('-');
@@ -80,6 +83,7 @@ refiningRaytracing(const Raytracer *basic_rt,
     timer.printTotalTime();
     // output of ratio and reset static timers
     TimerHandler::printRatio();
+    FlowMapCache::instance().printStats();
     TimerHandler::reset();
   }
   else
@@ -126,6 +130,7 @@ void shading(shared_ptr<Raytracer> raytracer,
     timer.printTotalTime();
     // output of ratio and reset static timers
     TimerHandler::printRatio();
+    FlowMapCache::instance().printStats();
     TimerHandler::reset();
   }
   else
@@ -147,6 +152,7 @@ void shading(shared_ptr<Raytracer> raytracer,
     timer.printTotalTime();
     // output of ratio and reset static timers
     TimerHandler::printRatio();
+    FlowMapCache::instance().printStats();
     TimerHandler::reset();
   }
   else
@@ -168,6 +174,7 @@ void shading(shared_ptr<Raytracer> raytracer,
     timer.printTotalTime();
     // output of ratio and reset static timers
     TimerHandler::printRatio();
+    FlowMapCache::instance().printStats();
     TimerHandler::reset();
   }
   else
@@ -189,6 +196,7 @@ void shading(shared_ptr<Raytracer> raytracer,
     timer.printTotalTime();
     // output of ratio and reset static timers
     TimerHandler::printRatio();
+    FlowMapCache::instance().printStats();
     TimerHandler::reset();
   }
   else
@@ -0,0 +1,137 @@
+#include "occupancygrid.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+    //--------------------------------------------------------------------------//
+    OccupancyGrid::OccupancyGrid(const AABB &domain, size_t resolution)
+        : m_min{domain.getMin()}
+    {
+        Vec3r extent = domain.getMax() - domain.getMin();
+        real edge = max({extent[0], extent[1], extent[2]}) / max(resolution, size_t(1));
+        for (size_t i = 0; i < 3; ++i)
+        {
+            m_dims[i] = max(size_t(1), size_t(ceil(extent[i] / edge - Globals::SMALL)));
+            m_cellSize[i] = extent[i] / m_dims[i];
+        }
+        m_cells.assign(m_dims[0] * m_dims[1] * m_dims[2], 1);
+    }
+
+    //--------------------------------------------------------------------------//
+    size_t OccupancyGrid::numOccupied() const
+    {
+        return count(m_cells.begin(), m_cells.end(), 1);
+    }
+
+    //--------------------------------------------------------------------------//
+    Vec3r OccupancyGrid::getVertex(size_t i, size_t j, size_t k) const
+    {
+        return Vec3r{m_min[0] + i * m_cellSize[0],
+                     m_min[1] + j * m_cellSize[1],
+                     m_min[2] + k * m_cellSize[2]};
+    }
+
+    //--------------------------------------------------------------------------//
+    bool OccupancyGrid::isOccupied(const Vec3r &pA, const Vec3r &pB) const
+    {
+        size_t lower[3], upper[3];
+        for (size_t d = 0; d < 3; ++d)
+        {
+            real a = (min(pA[d], pB[d]) - m_min[d]) / m_cellSize[d];
+            real b = (max(pA[d], pB[d]) - m_min[d]) / m_cellSize[d];
+            if (a < 0.0 || b > real(m_dims[d]))
+                return true;
+            lower[d] = min(size_t(a), m_dims[d] - 1);
+            upper[d] = min(size_t(b), m_dims[d] - 1);
+        }
+        for (size_t k = lower[2]; k <= upper[2]; ++k)
+            for (size_t j = lower[1]; j <= upper[1]; ++j)
+                for (size_t i = lower[0]; i <= upper[0]; ++i)
+                    if (m_cells[index(i, j, k)])
+                        return true;
+        return false;
+    }
+
+    //--------------------------------------------------------------------------//
+    void OccupancyGrid::dilate()
+    {
+        vector<uint8_t> dilated = m_cells;
+        for (size_t k = 0; k < m_dims[2]; ++k)
+            for (size_t j = 0; j < m_dims[1]; ++j)
+                for (size_t i = 0; i < m_dims[0]; ++i)
+                {
+                    if (!m_cells[index(i, j, k)])
+                        continue;
+                    for (size_t kk = (k > 0 ? k - 1 : 0); kk <= min(k + 1, m_dims[2] - 1); ++kk)
+                        for (size_t jj = (j > 0 ? j - 1 : 0); jj <= min(j + 1, m_dims[1] - 1); ++jj)
+                            for (size_t ii = (i > 0 ? i - 1 : 0); ii <= min(i + 1, m_dims[0] - 1); ++ii)
+                                dilated[index(ii, jj, kk)] = 1;
+                }
+        m_cells.swap(dilated);
+    }
+
+    //--------------------------------------------------------------------------//
+    OccupancyGrid::FileHeader OccupancyGrid::createHeader(const string &flowName,
+                                                          const SearchParams &search) const
+    {
+        FileHeader header;
+        memset(&header, 0, sizeof(FileHeader));
+        memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+        header.version = FILE_VERSION;
+        for (size_t d = 0; d < 3; ++d)
+        {
+            header.dims[d] = uint32_t(m_dims[d]);
+            header.bbox[2 * d] = m_min[d];
+            header.bbox[2 * d + 1] = m_min[d] + m_dims[d] * m_cellSize[d];
+        }
+        header.search[0] = search.t0_min;
+        header.search[1] = search.t0_max;
+        header.search[2] = search.tau_min;
+        header.search[3] = search.tau_max;
+        header.search[4] = search.dt;
+        strncpy(header.flow, flowName.c_str(), sizeof(header.flow) - 1);
+        return header;
+    }
+
+    //--------------------------------------------------------------------------//
+    bool OccupancyGrid::save(const string &filename,
+                             const string &flowName,
+                             const SearchParams &search) const
+    {
+        ofstream out(filename, ios::out | ios::binary | ios::trunc);
+        if (!out)
+            return false;
+        FileHeader header = createHeader(flowName, search);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(FileHeader));
+        out.write(reinterpret_cast<const char *>(m_cells.data()), m_cells.size());
+        return bool(out);
+    }
+
+    //--------------------------------------------------------------------------//
+    bool OccupancyGrid::load(const string &filename,
+                             const string &flowName,
+                             const SearchParams &search)
+    {
+        ifstream in(filename, ios::in | ios::binary);
+        if (!in)
+            return false;
+        FileHeader header, expected = createHeader(flowName, search);
+        if (!in.read(reinterpret_cast<char *>(&header), sizeof(FileHeader)) ||
+            0 != memcmp(&header, &expected, sizeof(FileHeader)))
+            return false;
+        vector<uint8_t> cells(m_cells.size());
+        if (!in.read(reinterpret_cast<char *>(cells.data()), cells.size()))
+            return false;
+        m_cells.swap(cells);
+        return true;
+    }
+    //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
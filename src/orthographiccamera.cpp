@@ -0,0 +1,76 @@
+#include "orthographiccamera.hh"
+
+using namespace std;
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+  //--------------------------------------------------------------------------//
+  OrthographicCamera::OrthographicCamera(const Vec3r &eye,
+                                         const Vec3r &lookat,
+                                         double plane_width,
+                                         size_t res_x,
+                                         size_t res_y,
+                                         const Vec3r &up)
+      : Camera{res_x, res_y},
+        m_up{up},
+        m_eye{eye},
+        m_lookat{lookat},
+        m_n{(eye - lookat).normalize()},
+        m_u{},
+        m_v{},
+        m_plane_half_width{plane_width / 2},
+        m_plane_half_height{double(res_y) / double(res_x) * m_plane_half_width},
+        m_bottom_left{},
+        m_plane_base_x{},
+        m_plane_base_y{}
+  {
+    m_u = (m_up % m_n).normalize(); // cross product
+    m_v = (m_n % m_u);              // cross product
+    m_bottom_left = m_eye - m_u * m_plane_half_width - m_v * m_plane_half_height;
+    m_plane_base_x = m_u * (2 * m_plane_half_width / res_x);
+    m_plane_base_y = m_v * (2 * m_plane_half_height / res_y);
+  }
+
+  //--------------------------------------------------------------------------//
+  OrthographicCamera::OrthographicCamera(const Vec3r &eye,
+                                         const Vec3r &lookat,
+                                         double plane_width,
+                                         size_t res_x,
+                                         size_t res_y,
+                                         CamUp up_axis)
+      : OrthographicCamera{eye,
+                           lookat,
+                           plane_width,
+                           res_x,
+                           res_y,
+                           (up_axis == CamUp::Y) ? Vec3r{0, 1, 0} : Vec3r{0, 0, 1}} {}
+
+  //--------------------------------------------------------------------------//
+  Ray OrthographicCamera::ray(double x, double y) const
+  {
+    return {m_bottom_left + m_plane_base_x * x + m_plane_base_y * y, -m_n};
+  }
+
+  //--------------------------------------------------------------------------//
+  Vec2r OrthographicCamera::projection(const Vec3r &pos) const
+  {
+    // the rays are parallel: the canvas position only depends on u and v
+    Vec3r rel = pos - m_bottom_left;
+    return Vec2r{(rel | m_u) * plane_width() / (m_plane_half_width * 2),
+                 (rel | m_v) * plane_height() / (m_plane_half_height * 2)};
+  }
+
+  //--------------------------------------------------------------------------//
+  shared_ptr<Camera> OrthographicCamera::create_increased(size_t multiplier) const
+  {
+    return make_shared<OrthographicCamera>(m_eye,
+                                           m_lookat,
+                                           m_plane_half_width * 2,
+                                           plane_width() * multiplier,
+                                           plane_height() * multiplier,
+                                           m_up);
+  }
+  //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
@@ -0,0 +1,78 @@
+#include "pixelfrontier.hh"
+
+#include <algorithm>
+#include <atomic>
+
+using namespace std;
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+    //--------------------------------------------------------------------------//
+    PixelFrontier::PixelFrontier(size_t width, size_t height)
+        : m_width{width},
+          m_height{height},
+          m_work{},
+          m_changed{},
+          m_queued(width * height, 0) {}
+
+    //--------------------------------------------------------------------------//
+    void PixelFrontier::seed(const Predicate &is_seed)
+    {
+        vector<size_t> seeds;
+        for (size_t cam_index = 0; cam_index < m_width * m_height; ++cam_index)
+            if (is_seed(cam_index))
+                seeds.push_back(cam_index);
+        m_changed.clear();
+        expand(seeds);
+    }
+
+    //--------------------------------------------------------------------------//
+    size_t PixelFrontier::iterate(const Predicate &visit)
+    {
+        // every pixel is visited once, so the buffer can hold all changes and the
+        // threads only need to reserve their position
+        m_changed.resize(m_work.size());
+        atomic<size_t> num_changed{0};
+#pragma omp parallel for schedule(dynamic)
+        for (size_t i = 0; i < m_work.size(); ++i)
+            if (visit(m_work[i]))
+                m_changed[num_changed.fetch_add(1, memory_order_relaxed)] = m_work[i];
+        m_changed.resize(num_changed.load());
+        sort(m_changed.begin(), m_changed.end());
+        expand(m_changed);
+        return m_changed.size();
+    }
+
+    //--------------------------------------------------------------------------//
+    void PixelFrontier::expand(const vector<size_t> &pixels)
+    {
+        m_work.clear();
+        auto enqueue = [&](size_t cam_index)
+        {
+            if (!m_queued[cam_index])
+            {
+                m_queued[cam_index] = 1;
+                m_work.push_back(cam_index);
+            }
+        };
+        for (size_t cam_index : pixels)
+        {
+            size_t x = cam_index % m_width, y = cam_index / m_width;
+            if (x > 0)
+                enqueue(cam_index - 1);
+            if (x < m_width - 1)
+                enqueue(cam_index + 1);
+            if (y > 0)
+                enqueue(cam_index - m_width);
+            if (y < m_height - 1)
+                enqueue(cam_index + m_width);
+        }
+        // reset the marks and visit the pixels in image order
+        for (size_t cam_index : m_work)
+            m_queued[cam_index] = 0;
+        sort(m_work.begin(), m_work.end());
+    }
+    //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
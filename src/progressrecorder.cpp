@@ -0,0 +1,104 @@
+#include "progressrecorder.hh"
+
+#include <chrono>
+
+using namespace std;
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+    //--------------------------------------------------------------------------//
+    ProgressRecorder::ProgressRecorder(const Handler &handler)
+        : m_handler{handler},
+          m_head{&m_stub},
+          mp_tail{&m_stub},
+          m_stub{},
+          m_stop{false}
+    {
+        m_thread = thread(&ProgressRecorder::writerLoop, this);
+    }
+
+    //--------------------------------------------------------------------------//
+    ProgressRecorder::~ProgressRecorder()
+    {
+        finish();
+    }
+
+    //--------------------------------------------------------------------------//
+    void ProgressRecorder::push(const Record &record)
+    {
+        pushNode(new Node{record});
+    }
+
+    //--------------------------------------------------------------------------//
+    void ProgressRecorder::finish()
+    {
+        m_stop.store(true, memory_order_release);
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    //--------------------------------------------------------------------------//
+    void ProgressRecorder::pushNode(Node *node)
+    {
+        // intrusive MPSC queue by D. Vyukov: only one atomic exchange per push
+        node->next.store(nullptr, memory_order_relaxed);
+        Node *prev = m_head.exchange(node, memory_order_acq_rel);
+        prev->next.store(node, memory_order_release);
+    }
+
+    //--------------------------------------------------------------------------//
+    ProgressRecorder::Node *ProgressRecorder::popNode()
+    {
+        Node *tail = mp_tail;
+        Node *next = tail->next.load(memory_order_acquire);
+        // skip the stub
+        if (tail == &m_stub)
+        {
+            if (!next)
+                return nullptr;
+            mp_tail = tail = next;
+            next = next->next.load(memory_order_acquire);
+        }
+        if (next)
+        {
+            mp_tail = next;
+            return tail;
+        }
+        // a producer is in the middle of a push: try again later
+        if (tail != m_head.load(memory_order_acquire))
+            return nullptr;
+        // tail is the last node: re-insert the stub so tail can be removed
+        pushNode(&m_stub);
+        next = tail->next.load(memory_order_acquire);
+        if (next)
+        {
+            mp_tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    //--------------------------------------------------------------------------//
+    void ProgressRecorder::writerLoop()
+    {
+        while (true)
+        {
+            // read the flag before draining, so no record pushed before finish() is lost
+            bool stop = m_stop.load(memory_order_acquire);
+            bool handled = false;
+            while (Node *node = popNode())
+            {
+                m_handler(*node->record);
+                delete node;
+                handled = true;
+            }
+            if (stop && m_head.load(memory_order_acquire) == mp_tail && !handled)
+                return;
+            if (!handled)
+                this_thread::sleep_for(chrono::microseconds(200));
+        }
+    }
+    //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//
@@ -1,20 +1,134 @@
 #include "progresssaver.hh"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
 using namespace std;
 
 //--------------------------------------------------------------------------//
 namespace RS
 {
+    //--------------------------------------------------------------------------//
+    namespace
+    {
+        //--------------------------------------------------------------------------//
+        /// Record of the binary save files. It either contains a found point or the
+        /// current start index.
+        struct ProgressRecord
+        {
+            uint32_t type; // RECORD_POINT or RECORD_START
+            uint32_t crc;  // checksum of the record (computed with crc = 0)
+            uint64_t cam_index;
+            double hit;
+            double pos[3];
+            double n[3];
+            double t0, tau, dist;
+        };
+        static_assert(sizeof(ProgressRecord) == 96, "unexpected padding in ProgressRecord");
+        //--------------------------------------------------------------------------//
+        struct SnapshotHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t crc; // checksum of the header (computed with crc = 0)
+            uint64_t start_index;
+            uint64_t count; // number of records following the header
+        };
+        //--------------------------------------------------------------------------//
+        constexpr uint32_t RECORD_POINT = 1;
+        constexpr uint32_t RECORD_START = 2;
+        constexpr char SNAPSHOT_MAGIC[8] = "RSPROG";
+        constexpr uint32_t SNAPSHOT_VERSION = 1;
+        constexpr size_t MIN_COMPACTION_RECORDS = 4096; // the log is not compacted below this size
+
+        //--------------------------------------------------------------------------//
+        /// CRC-32 (IEEE polynomial).
+        uint32_t crc32(const void *data, size_t size)
+        {
+            static const auto table = []
+            {
+                array<uint32_t, 256> t{};
+                for (uint32_t i = 0; i < 256; ++i)
+                {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; ++k)
+                        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    t[i] = c;
+                }
+                return t;
+            }();
+            uint32_t crc = 0xFFFFFFFFu;
+            const unsigned char *p = static_cast<const unsigned char *>(data);
+            for (size_t i = 0; i < size; ++i)
+                crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+            return crc ^ 0xFFFFFFFFu;
+        }
+
+        //--------------------------------------------------------------------------//
+        template <typename T>
+        void sealRecord(T &record)
+        {
+            record.crc = 0;
+            record.crc = crc32(&record, sizeof(T));
+        }
+
+        //--------------------------------------------------------------------------//
+        template <typename T>
+        bool checkRecord(T record)
+        {
+            uint32_t crc = record.crc;
+            record.crc = 0;
+            return crc == crc32(&record, sizeof(T));
+        }
+
+        //--------------------------------------------------------------------------//
+        ProgressRecord toRecord(const RSIntersection &rsi)
+        {
+            const RecPoint &rp = rsi.rp.value();
+            ProgressRecord record{};
+            record.type = RECORD_POINT;
+            record.cam_index = rsi.cam_index;
+            record.hit = rsi.hit.value();
+            for (int i = 0; i < 3; ++i)
+            {
+                record.pos[i] = rp.pos[i];
+                record.n[i] = rp.n[i];
+            }
+            record.t0 = rp.t0;
+            record.tau = rp.tau;
+            record.dist = rp.dist;
+            sealRecord(record);
+            return record;
+        }
+
+        //--------------------------------------------------------------------------//
+        ProgressRecord toStartRecord(size_t start_index)
+        {
+            ProgressRecord record{};
+            record.type = RECORD_START;
+            record.cam_index = start_index;
+            sealRecord(record);
+            return record;
+        }
+    }
+
     //--------------------------------------------------------------------------//
     ProgressSaver::ProgressSaver(const string &save_dir, size_t cam_width, size_t cam_height)
         : start_index{0},
           saved{},
           waiting{},
-          complete_rewrite{false},
+          updates{},
           next_save_index{0},
           count_waiting_positives{0},
+          log_records{0},
+          needs_snapshot{false},
           file_start{save_dir + "/progress_start.txt"},
           file_vec{save_dir + "/progress_points.txt"},
+          file_log{save_dir + "/progress.log"},
+          file_snapshot{save_dir + "/progress.snapshot"},
           width{cam_width},
           height{cam_height},
           index_map{nullptr}
@@ -43,10 +157,11 @@ namespace RS
         // or updating an existing one
         if (data.cam_index >= start_index) // case 1
         {
-            waiting.push_back(data);
-            if (waiting.size() > 1 && waiting[waiting.size() - 2].cam_index < waiting.back().cam_index)
-                sort(waiting.begin(), waiting.end(), [](RSIntersection a, RSIntersection b)
-                     { return a.cam_index > b.cam_index; });
+            // keep "waiting" sorted in descending order (tiles deliver many updates out of order)
+            auto pos = upper_bound(waiting.begin(), waiting.end(), data.cam_index,
+                                   [](size_t cam_index, const RSIntersection &obj)
+                                   { return cam_index > obj.cam_index; });
+            waiting.insert(pos, data);
             if (data.rp)
                 ++count_waiting_positives;
 
@@ -69,7 +184,7 @@ namespace RS
             size_t index = getRSIPosition(data.cam_index);
             if (data.rp)
             {
-                complete_rewrite = true;
+                updates.push_back(data);
                 if (index < width * height) // existing entry (simple case)
                 {
                     saved[index] = data;
@@ -90,6 +205,9 @@ namespace RS
                     size_t x = data.cam_index % width, y = data.cam_index / width;
                     saved.insert(saved.begin() + insert_pos, data);
                     index_map[x][y] = insert_pos;
+                    // the point is already contained in "updates"
+                    if (insert_pos < next_save_index)
+                        ++next_save_index;
                 }
             }
             // theoretically there is also the case that an entry can be deleted,
@@ -100,40 +218,164 @@ namespace RS
     //--------------------------------------------------------------------------//
     void ProgressSaver::saveData()
     {
-        // save vector
-        ofstream file;
-        size_t start = 0;
-        if (complete_rewrite)
-            file.open(file_vec);
-        else
+        if (needs_snapshot || log_records > max(2 * saved.size(), MIN_COMPACTION_RECORDS))
         {
-            file.open(file_vec, ios_base::app);
-            start = next_save_index;
+            writeSnapshot();
+            return;
         }
+
+        // append the new and updated points and the current start index to the log
+        vector<ProgressRecord> records;
+        for (size_t i = next_save_index; i < saved.size(); ++i)
+            records.push_back(toRecord(saved[i]));
+        for (const RSIntersection &rsi : updates)
+            records.push_back(toRecord(rsi));
+        records.push_back(toStartRecord(start_index));
+
+        ofstream file{file_log, ios_base::binary | ios_base::app};
         if (file)
         {
-            for (size_t i = start; i < saved.size(); ++i)
-            {
-                RSIntersection p = saved[i];
-                file << p.cam_index << ' '
-                     << p.hit.value() << ' '
-                     << p.rp.value().t0 << ' '
-                     << p.rp.value().tau << "\n";
-            }
+            file.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(ProgressRecord));
+            file.flush();
+            log_records += records.size();
         }
         file.close();
         next_save_index = saved.size();
-        complete_rewrite = false;
+        updates.clear();
+    }
 
-        // save start index
-        file = ofstream(file_start);
-        if (file)
-            file << start_index;
+    //--------------------------------------------------------------------------//
+    void ProgressSaver::writeSnapshot()
+    {
+        SnapshotHeader header{};
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.start_index = start_index;
+        header.count = saved.size();
+        sealRecord(header);
+
+        // write to a temporary file first, so there is always a valid snapshot
+        string tmp = file_snapshot + ".tmp";
+        ofstream file{tmp, ios_base::binary | ios_base::trunc};
+        if (!file)
+            return;
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (const RSIntersection &rsi : saved)
+        {
+            ProgressRecord record = toRecord(rsi);
+            file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+        }
+        file.flush();
+        bool ok = bool(file);
         file.close();
+        if (!ok || rename(tmp.c_str(), file_snapshot.c_str()) != 0)
+            return;
+
+        // the log is contained in the snapshot now (replaying it again would not be harmful)
+        ofstream{file_log, ios_base::binary | ios_base::trunc};
+        log_records = 0;
+        next_save_index = saved.size();
+        updates.clear();
+        needs_snapshot = false;
     }
 
     //--------------------------------------------------------------------------//
     void ProgressSaver::loadData(const Camera &cam)
+    {
+        saved.clear();
+        needs_snapshot = false;
+        if (!loadBinary(cam))
+        {
+            loadText(cam);
+            // convert the old format with the next save
+            needs_snapshot = !saved.empty() || start_index > 0;
+        }
+
+        // set other variables
+        next_save_index = saved.size();
+        updates.clear();
+        count_waiting_positives = 0;
+
+        // init index_map
+        size_t vec_pos = 0;
+        for (size_t cam_index = 0; cam_index < width * height; ++cam_index)
+        {
+            size_t x = cam_index % width, y = cam_index / width;
+            if (vec_pos < saved.size() && saved[vec_pos].cam_index == cam_index)
+                index_map[x][y] = vec_pos++;
+            else
+                index_map[x][y] = numeric_limits<size_t>::max();
+        }
+    }
+
+    //--------------------------------------------------------------------------//
+    bool ProgressSaver::loadBinary(const Camera &cam)
+    {
+        ifstream snapshot{file_snapshot, ios_base::binary};
+        ifstream log{file_log, ios_base::binary};
+        if (!snapshot && !log)
+            return false;
+
+        // points are sorted by their camera index; later records replace earlier ones
+        map<size_t, ProgressRecord> points;
+        size_t start = 0;
+        SnapshotHeader header;
+        if (snapshot &&
+            snapshot.read(reinterpret_cast<char *>(&header), sizeof(header)) &&
+            memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 &&
+            header.version == SNAPSHOT_VERSION &&
+            checkRecord(header))
+        {
+            start = header.start_index;
+            ProgressRecord record;
+            for (uint64_t i = 0; i < header.count; ++i)
+            {
+                if (!snapshot.read(reinterpret_cast<char *>(&record), sizeof(record)) || !checkRecord(record))
+                    break;
+                points[record.cam_index] = record;
+            }
+        }
+
+        // replay the log up to the first incomplete or corrupted record
+        // (e.g. if the program was interrupted while writing)
+        ProgressRecord record;
+        log_records = 0;
+        while (log && log.read(reinterpret_cast<char *>(&record), sizeof(record)) && checkRecord(record))
+        {
+            ++log_records;
+            if (record.type == RECORD_POINT)
+                points[record.cam_index] = record;
+            else if (record.type == RECORD_START)
+                start = record.cam_index;
+        }
+        // new records must not be appended behind a corrupted one
+        if (log.is_open())
+        {
+            log.clear();
+            log.seekg(0, ios_base::end);
+            if (size_t(log.tellg()) != log_records * sizeof(ProgressRecord))
+                needs_snapshot = true;
+        }
+
+        start_index = start;
+        for (const auto &[cam_index, r] : points)
+        {
+            // points behind the start index are calculated again
+            if (cam_index >= start_index || cam_index >= width * height)
+                break;
+            Ray ray = cam.ray(cam_index % width, cam_index / width);
+            RecPoint rp{Vec3r(r.pos[0], r.pos[1], r.pos[2]),
+                        Vec3r(r.n[0], r.n[1], r.n[2]),
+                        r.t0,
+                        r.tau,
+                        r.dist};
+            saved.push_back(RSIntersection{cam_index, ray, {r.hit}, {rp}});
+        }
+        return true;
+    }
+
+    //--------------------------------------------------------------------------//
+    void ProgressSaver::loadText(const Camera &cam)
     {
         ifstream file{file_start};
         if (file)
@@ -174,21 +416,6 @@ namespace RS
                 start_index = saved.back().cam_index;
             }
         }
-        // set other variables
-        next_save_index = saved.size();
-        complete_rewrite = false;
-        count_waiting_positives = 0;
-
-        // init index_map
-        size_t vec_pos = 0;
-        for (size_t cam_index = 0; cam_index < width * height; ++cam_index)
-        {
-            size_t x = cam_index % width, y = cam_index / width;
-            if (vec_pos < saved.size() && saved[vec_pos].cam_index == cam_index)
-                index_map[x][y] = vec_pos++;
-            else
-                index_map[x][y] = numeric_limits<size_t>::max();
-        }
     }
     //--------------------------------------------------------------------------//
 }
@@ -1,6 +1,8 @@
 #include "raytracer.hh"
 
 #include "box.hh"
+#include "flowmapcache.hh"
+#include "progressrecorder.hh"
 #include "shader.hh"
 #include "timer.hh"
 
@@ -38,6 +40,62 @@ namespace RS
     m_texture_tau.write_ppm(m_save_dir + "/tau.ppm");
   }
 
+  //--------------------------------------------------------------------------//
+  size_t Raytracer::numTiles() const
+  {
+    size_t tile_size = Globals::RENDER_TILESIZE;
+    size_t tiles_x = (m_cam->plane_width() + tile_size - 1) / tile_size;
+    size_t tiles_y = (m_cam->plane_height() + tile_size - 1) / tile_size;
+    return tiles_x * tiles_y;
+  }
+
+  //--------------------------------------------------------------------------//
+  vector<size_t> Raytracer::getTilePixels(size_t tile, size_t start_index) const
+  {
+    size_t width = m_cam->plane_width();
+    size_t height = m_cam->plane_height();
+    size_t tile_size = Globals::RENDER_TILESIZE;
+    size_t tiles_x = (width + tile_size - 1) / tile_size;
+    size_t x0 = (tile % tiles_x) * tile_size, y0 = (tile / tiles_x) * tile_size;
+
+    vector<size_t> pixels;
+    for (size_t y = y0; y < min(y0 + tile_size, height); ++y)
+      for (size_t x = x0; x < min(x0 + tile_size, width); ++x)
+        if (y * width + x >= start_index)
+          pixels.push_back(y * width + x);
+    return pixels;
+  }
+
+  //--------------------------------------------------------------------------//
+  optional<SearchWindow> Raytracer::getPriorWindow(size_t x,
+                                                   size_t y,
+                                                   const unordered_map<size_t, Vec2r> &hits,
+                                                   const optional<Vec2r> &last_hit) const
+  {
+    size_t width = m_cam->plane_width();
+    optional<SearchWindow> window;
+    // left neighbour and upper row (rendered before in row-major order)
+    const int offsets[4][2] = {{-1, 0}, {-1, -1}, {0, -1}, {1, -1}};
+    for (auto &o : offsets)
+    {
+      size_t nx = x + o[0], ny = y + o[1]; // wraps around for -1
+      if (nx >= width || ny > y)
+        continue;
+      auto it = hits.find(ny * width + nx);
+      if (it == hits.end())
+        continue;
+      if (window)
+        window->extend(it->second[0], it->second[1]);
+      else
+        window = SearchWindow(it->second[0], it->second[1]);
+    }
+    if (!window && last_hit)
+      window = SearchWindow((*last_hit)[0], (*last_hit)[1]);
+    if (window)
+      window->widen(Globals::RENDER_PRIOR_MARGIN * m_scene->getRecSurface().getSearchParams().dt);
+    return window;
+  }
+
   //--------------------------------------------------------------------------//
   void Raytracer::render()
   {
@@ -55,32 +113,14 @@ namespace RS
     if (checked_domain_rays > 0)
       cout << "Rays saved from past calculation: " << checked_domain_rays << endl;
 
-    omp_lock_t lck;
-    omp_init_lock(&lck);
-    TimerHandler::reset();
-#pragma omp parallel for schedule(dynamic)
-    for (size_t cam_index = m_progress.getStartIndex(); cam_index < width * height; ++cam_index)
+    // results are recorded by a single writer thread, so the workers never wait
+    // for progress updates, disk saves or console output
+    auto handle_result = [&](const ProgressRecorder::Record &record)
     {
-      size_t tid = TimerHandler::overall_timer().createTimer();
-      size_t x = cam_index % width;
-      size_t y = cam_index / width;
-      Ray ray = m_cam->ray(x, y);
-
-      // contains the important information about whether there is a RecPoint and where
-      RSIntersection rsi{cam_index, ray, {}, {}};
-      // actual calculation
-      bool rs_domain_intersected;
-      array<color, 2> colors = m_scene->raytracing(ray,
-                                                   rsi,
-                                                   rs_domain_intersected);
-      m_texture_t0.pixel(x, y) = colors[0];
-      m_texture_tau.pixel(x, y) = colors[1];
-
-      omp_set_lock(&lck);
       // insert result
-      m_progress.update(rsi);
+      m_progress.update(record.rsi);
       // if needed: increase overview variable + save to disc + update output
-      if (rs_domain_intersected)
+      if (record.domain_intersected)
       {
         if (++checked_domain_rays % 120 == 0)
           saveToDisc();
@@ -88,10 +128,52 @@ namespace RS
         cout << "\rFinished: " << checked_domain_rays << " / " << total_domain_rays
              << " | RecPoints found: " << m_progress.numPointsFound() << flush;
       }
-      omp_unset_lock(&lck);
+    };
+    ProgressRecorder recorder{handle_result};
+    TimerHandler::reset();
+    // the image is processed in tiles, so neighbouring rays are traced by the same
+    // thread and can reuse their flow maps without locking the shared cache
+    size_t start_index = m_progress.getStartIndex();
+    size_t num_tiles = numTiles();
+#pragma omp parallel for schedule(dynamic)
+    for (size_t tile = 0; tile < num_tiles; ++tile)
+    {
+      FlowMapCache::TileScope tile_cache;
+      // (t0, tau) of the hits in the tile: neighbouring pixels usually hit the
+      // surface with similar values, so these are searched first
+      unordered_map<size_t, Vec2r> tile_hits;
+      optional<Vec2r> last_hit;
+      for (size_t cam_index : getTilePixels(tile, start_index))
+      {
+        size_t tid = TimerHandler::overall_timer().createTimer();
+        size_t x = cam_index % width;
+        size_t y = cam_index / width;
+        Ray ray = m_cam->ray(x, y);
 
-      TimerHandler::overall_timer().deleteTimer(tid);
+        // contains the important information about whether there is a RecPoint and where
+        RSIntersection rsi{cam_index, ray, {}, {}};
+        // actual calculation
+        bool rs_domain_intersected;
+        array<color, 2> colors = m_scene->raytracing(ray,
+                                                     rsi,
+                                                     rs_domain_intersected,
+                                                     0.0,
+                                                     numeric_limits<real>::max(),
+                                                     getPriorWindow(x, y, tile_hits, last_hit));
+        if (rsi.rp.has_value())
+        {
+          last_hit = Vec2r(rsi.rp->t0, rsi.rp->tau);
+          tile_hits[cam_index] = *last_hit;
+        }
+        m_texture_t0.pixel(x, y) = colors[0];
+        m_texture_tau.pixel(x, y) = colors[1];
+
+        recorder.push({rsi, rs_domain_intersected, rs_domain_intersected});
+
+        TimerHandler::overall_timer().deleteTimer(tid);
+      }
     }
+    recorder.finish();
     saveToDisc();
 
     cout << "\r\33[KTotal RecPoints found: " << m_progress.numPointsFound() << " / " << total_domain_rays << endl;
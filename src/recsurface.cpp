@@ -1,5 +1,11 @@
 #include "recsurface.hh"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <omp.h>
+
 #include "line.hh"
 
 using namespace std;
@@ -21,6 +27,162 @@ namespace RS
                            const SearchParams &search)
         : p_flow{p_flow}, m_data{data}, m_search{search} {}
 
+    //--------------------------------------------------------------------------//
+    void RecSurface::useOccupancyGrid(const string &filename, size_t resolution)
+    {
+        auto grid = make_shared<OccupancyGrid>(m_data.domain, resolution);
+        if (grid->load(filename, p_flow->getName(), m_search))
+            cout << "Loaded occupancy grid from disc";
+        else
+        {
+            cout << "Building occupancy grid" << endl;
+            buildOccupancyGrid(*grid);
+            grid->save(filename, p_flow->getName(), m_search);
+            cout << "\r\33[KBuilt occupancy grid";
+        }
+        cout << " (" << grid->numOccupied() << " / " << grid->numCells() << " cells occupied)" << endl;
+        mp_occupancy = grid;
+    }
+
+    //--------------------------------------------------------------------------//
+    void RecSurface::useFlowMapLattice(const string &filename, size_t resolution)
+    {
+        vector<real> t0s, taus;
+        getSearchNodes(t0s, taus);
+        auto lattice = make_shared<FlowMapLattice>(m_data.domain, resolution, t0s, taus);
+        if (lattice->load(filename, p_flow->getName(), m_search))
+            cout << "Loaded flow map lattice from disc";
+        else
+        {
+            cout << "Building flow map lattice" << endl;
+            auto sampler = [this](const Vec3r &pos, vector<optional<Vec3r>> &ends)
+            {
+                if (!p_flow->isInside(pos))
+                    return;
+                FlowSampler3D flowSampler(*p_flow);
+                ends = sampleEndPositions(pos, flowSampler);
+            };
+            auto exact = [this](const Vec3r &pos, real t0, real tau) -> optional<Vec3r>
+            {
+                if (!p_flow->isInside(pos))
+                    return {};
+                FlowSampler3D flowSampler(*p_flow);
+                Vec3r residual;
+                if (!HyperLine::evalResidual(flowSampler, pos, t0, tau, &residual))
+                    return {};
+                return pos + residual;
+            };
+            if (!lattice->build(filename, p_flow->getName(), m_search, sampler, exact))
+                return;
+            cout << "Built flow map lattice";
+        }
+        cout << " (" << lattice->numVertices() << " vertices, error at tau_max " << lattice->getError(m_search.tau_max) << ")" << endl;
+        mp_lattice = lattice;
+    }
+
+    //--------------------------------------------------------------------------//
+    void RecSurface::buildOccupancyGrid(OccupancyGrid &grid) const
+    {
+        vector<real> t0s, taus;
+        getSearchNodes(t0s, taus);
+        size_t num_t0s = t0s.size(), num_taus = taus.size();
+        size_t nx = grid.getDim(0), ny = grid.getDim(1), nz = grid.getDim(2);
+
+        // a flow map lattice with the same vertices and nodes already holds the end
+        // positions, so they are not integrated again
+        const FlowMapLattice *p_lattice = mp_lattice.get();
+        if (p_lattice && (p_lattice->getDim(0) != nx || p_lattice->getDim(1) != ny || p_lattice->getDim(2) != nz ||
+                          p_lattice->getT0s() != t0s || p_lattice->getTaus() != taus))
+            p_lattice = nullptr;
+
+        // the residuals are sampled on two layers of vertices at once
+        vector<vector<optional<Vec3r>>> lower((nx + 1) * (ny + 1)), upper((nx + 1) * (ny + 1));
+        auto sampleLayer = [&](size_t k, vector<vector<optional<Vec3r>>> &layer)
+        {
+#pragma omp parallel for schedule(dynamic)
+            for (size_t v = 0; v < layer.size(); ++v)
+            {
+                size_t i = v % (nx + 1), j = v / (nx + 1);
+                Vec3r pos = grid.getVertex(i, j, k);
+                layer[v].clear();
+                if (!p_flow->isInside(pos))
+                    continue;
+                if (p_lattice)
+                {
+                    p_lattice->getVertexEnds(i, j, k, layer[v]);
+                    for (size_t n = 0; n < layer[v].size(); ++n)
+                        if (layer[v][n])
+                            layer[v][n] = (*layer[v][n] - pos) / taus[n % num_taus];
+                    continue;
+                }
+                FlowSampler3D sampler(*p_flow);
+                size_t unused;
+                layer[v] = sampleResiduals(pos, sampler, &unused);
+            }
+        };
+
+        sampleLayer(0, upper);
+        for (size_t k = 0; k < nz; ++k)
+        {
+            lower.swap(upper);
+            sampleLayer(k + 1, upper);
+#pragma omp parallel for schedule(dynamic)
+            for (size_t c = 0; c < nx * ny; ++c)
+            {
+                size_t i = c % nx, j = c / nx;
+                const vector<optional<Vec3r>> *corners[8] = {
+                    &lower[j * (nx + 1) + i], &lower[j * (nx + 1) + i + 1],
+                    &lower[(j + 1) * (nx + 1) + i], &lower[(j + 1) * (nx + 1) + i + 1],
+                    &upper[j * (nx + 1) + i], &upper[j * (nx + 1) + i + 1],
+                    &upper[(j + 1) * (nx + 1) + i], &upper[(j + 1) * (nx + 1) + i + 1]};
+                // vertices outside of the flow domain are not known
+                bool occupied = false;
+                for (auto corner : corners)
+                    if (corner->empty())
+                        occupied = true;
+                // sign test for each t0/tau cell with the 32 residuals of its corners
+                for (size_t a = 0; !occupied && a + 1 < num_t0s; ++a)
+                    for (size_t b = 0; !occupied && b + 1 < num_taus; ++b)
+                    {
+                        // the cell contains the trivial zero at tau = 0
+                        if (taus[b] < 0.0 && taus[b + 1] > 0.0)
+                        {
+                            occupied = true;
+                            break;
+                        }
+                        Vec3r r_min(numeric_limits<real>::max(), numeric_limits<real>::max(), numeric_limits<real>::max());
+                        Vec3r r_max = -r_min;
+                        for (auto corner : corners)
+                            for (size_t node : {a * num_taus + b, a * num_taus + b + 1,
+                                                (a + 1) * num_taus + b, (a + 1) * num_taus + b + 1})
+                            {
+                                // the particle leaves the domain: unknown
+                                if (!(*corner)[node])
+                                {
+                                    occupied = true;
+                                    continue;
+                                }
+                                for (size_t d = 0; d < 3; ++d)
+                                {
+                                    r_min[d] = std::min(r_min[d], (*(*corner)[node])[d]);
+                                    r_max[d] = std::max(r_max[d], (*(*corner)[node])[d]);
+                                }
+                            }
+                        occupied = occupied ||
+                                   (r_min[0] <= 0.0 && r_max[0] >= 0.0 &&
+                                    r_min[1] <= 0.0 && r_max[1] >= 0.0 &&
+                                    r_min[2] <= 0.0 && r_max[2] >= 0.0);
+                    }
+                grid.setOccupied(i, j, k, occupied);
+            }
+            cout << "\rOccupancy grid: layer " << k + 1 << " / " << nz << flush;
+        }
+        // the residuals are only sampled at the vertices, so the sign test of a
+        // HyperLine inside a cell might pass where the one of the cell fails. The
+        // dilation covers most of these cases, but it is no bound.
+        grid.dilate();
+    }
+
     //--------------------------------------------------------------------------//
     optional<Vec2r> RecSurface::getDomainIntersections(const Ray &ray, real begin_at, real end_at) const
     {
@@ -28,9 +190,20 @@ namespace RS
     }
 
     //--------------------------------------------------------------------------//
-    optional<RecPoint> RecSurface::getRecPoint(HyperLine &hl, const Ray &ray) const
+    optional<RecPoint> RecSurface::getRecPoint(HyperLine &hl,
+                                               const Ray &ray,
+                                               const optional<SearchWindow> &window) const
     {
-        vector<RecPoint> recPoints = hl.getRecirculationPoints(m_search, false);
+        vector<RecPoint> recPoints;
+        if (m_search.first_hit)
+        {
+            // stop at the first accepted point, else fall back to the best candidates
+            auto first = hl.getFirstRecirculationPoint(m_search, m_accept, window, &recPoints);
+            if (first.has_value())
+                return first;
+        }
+        else
+            recPoints = hl.getRecirculationPoints(m_search, false);
         if (!recPoints.empty())
         {
             size_t min_id = 0;
@@ -54,7 +227,8 @@ namespace RS
     RSIntersection RecSurface::searchIntersection(const Ray &ray,
                                                   real begin_at,
                                                   real end_at,
-                                                  bool *needed_integration) const
+                                                  bool *needed_integration,
+                                                  const optional<SearchWindow> &window) const
     {
         RSIntersection result{numeric_limits<size_t>::max(), ray, {}, {}};
 
@@ -70,32 +244,14 @@ namespace RS
             if (needed_integration)
                 *needed_integration = true;
 
-            // setup some values and objects
-            real &i_min = range.value()[0];
-            real &i_max = range.value()[1];
-            real step_size = m_data.step_size;
-
-            FlowSampler3D sampler(*p_flow);
-            Vec3r pA, pB = ray(i_min);
-            HyperLine hl{pB, pB, &sampler}; // will be overwritten in first iteration
-
-            // iterate over the ray
-            for (real i = i_min; i < i_max; i += step_size)
+            auto opt = searchSegments(
+                ray, range.value()[0], range.value()[1],
+                [](const Vec3r &, const Vec3r &) { return true; },
+                window);
+            if (opt.has_value())
             {
-                pA = pB;
-                pB = ray(std::min(i + step_size, i_max));
-                hl = HyperLine(hl.getHyperPointB(), pB);
-
-                if (p_flow->isInside(pA) && p_flow->isInside(pB))
-                {
-                    auto opt = getRecPoint(hl, ray);
-                    if (opt.has_value())
-                    {
-                        result.rp = opt;
-                        result.hit = (ray.origin() - opt->pos).norm();
-                        break;
-                    }
-                }
+                result.rp = opt;
+                result.hit = (ray.origin() - opt->pos).norm();
             }
         }
         return result;
@@ -125,38 +281,146 @@ namespace RS
             if (needed_integration)
                 *needed_integration = true;
 
-            real &i_min = range.value()[0];
-            real &i_max = range.value()[1];
-            real step_size = m_data.step_size;
-
-            FlowSampler3D sampler(*p_flow);
-            Vec3r pA, pB = ray(i_min);
-            HyperLine hl{pB, pB, &sampler}; // will be overwritten in first iteration
+            // determines if the line needs test depending on whether the search is inverted
+            auto needs_test = [&](const Vec3r &pA, const Vec3r &pB)
+            {
+                return doesLineNeedTest(pA, pB, cam, progress, objects) != invert_search;
+            };
+            auto opt = searchSegments(ray, range.value()[0], range.value()[1], needs_test);
+            if (opt.has_value())
+            {
+                result.rp = opt;
+                result.hit = (ray.origin() - opt->pos).norm();
+            }
+        }
+        return result;
+    }
 
-            // iterate over ray
-            for (real i = i_min; i < i_max; i += step_size)
+    //--------------------------------------------------------------------------//
+    optional<RecPoint> RecSurface::searchSegments(const Ray &ray,
+                                                  real i_min,
+                                                  real i_max,
+                                                  const SegmentFilter &needs_test,
+                                                  const optional<SearchWindow> &window) const
+    {
+        real step_size = m_data.step_size;
+        size_t num_segments = 0;
+        while (i_min + num_segments * step_size < i_max)
+            ++num_segments;
+        if (0 == num_segments)
+            return {};
+
+        vector<optional<RecPoint>> hits(num_segments);
+        atomic<size_t> next_segment{0};
+        atomic<size_t> first_hit{num_segments};
+        auto search = [&](FlowSampler3D &sampler, size_t k)
+        {
+            Vec3r pA = ray(i_min + k * step_size);
+            Vec3r pB = ray(std::min(i_min + (k + 1) * step_size, i_max));
+            if (!p_flow->isInside(pA) || !p_flow->isInside(pB) ||
+                (mp_occupancy && !mp_occupancy->isOccupied(pA, pB)) ||
+                !needs_test(pA, pB))
+                return;
+            HyperLine hl{pA, pB, &sampler};
+            hl.setLattice(mp_lattice.get());
+            hits[k] = getRecPoint(hl, ray, window);
+            if (hits[k].has_value())
             {
-                pA = pB;
-                pB = ray(std::min(i + step_size, i_max));
-                hl = HyperLine(hl.getHyperPointB(), pB);
+                size_t current = first_hit.load();
+                while (k < current && !first_hit.compare_exchange_weak(current, k))
+                    ;
+            }
+        };
 
-                if (p_flow->isInside(pA) && p_flow->isInside(pB))
+        // inside a parallel region there is one task per segment, which idle threads
+        // of the team (e.g. waiting at the end of a parallel loop) can take. Each task
+        // searches the next untested segment, so the segments are started in the
+        // order along the ray, and the tasks behind the nearest hit end right away.
+        if (Globals::RENDER_RAYTASKS && omp_in_parallel() && omp_get_num_threads() > 1)
+        {
+#pragma omp taskloop grainsize(1) default(shared)
+            for (size_t s = 0; s < num_segments; ++s)
+            {
+                size_t k = next_segment.fetch_add(1);
+                if (k < first_hit.load())
                 {
-                    // determines if the line needs test depending on whether the search is inverted
-                    if (doesLineNeedTest(pA, pB, cam, progress, objects) != invert_search)
-                    {
-                        auto opt = getRecPoint(hl, ray);
-                        if (opt.has_value())
-                        {
-                            result.rp = opt;
-                            result.hit = (ray.origin() - opt->pos).norm();
-                            break;
-                        }
-                    }
+                    FlowSampler3D sampler(*p_flow);
+                    search(sampler, k);
                 }
             }
         }
-        return result;
+        else
+        {
+            FlowSampler3D sampler(*p_flow);
+            for (size_t k = 0; k < first_hit.load(); ++k)
+                search(sampler, k);
+        }
+
+        size_t k = first_hit.load();
+        if (k < num_segments)
+            return hits[k];
+        return {};
+    }
+
+    //--------------------------------------------------------------------------//
+    void RecSurface::getSearchNodes(vector<real> &t0s, vector<real> &taus) const
+    {
+        // nodes of the search cells (see HyperLine::getSearchCells)
+        t0s.assign(1, m_search.t0_min);
+        taus.assign(1, m_search.tau_min);
+        while (t0s.back() < m_search.t0_max)
+            t0s.push_back(std::min(t0s.back() + m_search.dt, m_search.t0_max));
+        while (taus.back() < m_search.tau_max)
+            taus.push_back(std::min(taus.back() + m_search.dt, m_search.tau_max));
+        for (real &tau : taus)
+            if (abs(tau) < Globals::TAUMIN)
+                tau = std::copysign(Globals::TAUMIN, tau);
+    }
+
+    //--------------------------------------------------------------------------//
+    vector<optional<Vec3r>> RecSurface::sampleEndPositions(const Vec3r &pos,
+                                                           FlowSampler3D &sampler) const
+    {
+        vector<real> t0s, taus;
+        getSearchNodes(t0s, taus);
+
+        HyperPoint point{pos, &sampler};
+        vector<optional<Vec3r>> ends;
+        ends.reserve(t0s.size() * taus.size());
+        for (real t0 : t0s)
+        {
+            // one flow map per direction covers the column
+            shared_ptr<FlowMap3D> backward, forward;
+            if (taus.front() < 0.0)
+                backward = point.getFlowMap(t0, taus.front());
+            if (taus.back() > 0.0)
+                forward = point.getFlowMap(t0, taus.back());
+            for (real tau : taus)
+            {
+                const shared_ptr<FlowMap3D> &flowMap = tau < 0.0 ? backward : forward;
+                if (flowMap->empty() || !flowMap->reaches(tau))
+                    ends.emplace_back();
+                else
+                    ends.emplace_back(flowMap->eval_position_at(flowMap->startTime() + tau));
+            }
+        }
+        return ends;
+    }
+
+    //--------------------------------------------------------------------------//
+    vector<optional<Vec3r>> RecSurface::sampleResiduals(const Vec3r &pos,
+                                                        FlowSampler3D &sampler,
+                                                        size_t *p_num_taus) const
+    {
+        vector<real> t0s, taus;
+        getSearchNodes(t0s, taus);
+        *p_num_taus = taus.size();
+
+        vector<optional<Vec3r>> residuals = sampleEndPositions(pos, sampler);
+        for (size_t i = 0; i < residuals.size(); ++i)
+            if (residuals[i])
+                residuals[i] = (*residuals[i] - pos) / taus[i % taus.size()];
+        return residuals;
     }
 
     //--------------------------------------------------------------------------//
@@ -229,6 +493,134 @@ namespace RS
                 return Vec3r{0, 0, 0};
         }
 
+        return normalFromPoints(rp, ray, points);
+    }
+
+    //--------------------------------------------------------------------------//
+    vector<Vec3r> RecSurface::estimateFlowNormals(const vector<const RSIntersection *> &rsis,
+                                                  real offset_space,
+                                                  size_t max_steps_smaller) const
+    {
+        // a lattice edge of length offset_space: index of its lower vertex and its axis
+        typedef array<int64_t, 4> Edge;
+        typedef array<int64_t, 3> Vertex;
+        typedef void (*Layout)(const Vertex &, vector<Edge> &);
+        // the sides of the layouts have a length of two lattice edges
+        Layout cross = [](const Vertex &c, vector<Edge> &edges)
+        {
+            // one square per plane, a is the axis of its normal
+            for (int64_t a = 0; a < 3; ++a)
+            {
+                int64_t b = (a + 1) % 3, d = (a + 2) % 3;
+                for (int64_t side : {-1, 1})
+                    for (int64_t half : {-1, 0})
+                    {
+                        Edge e_b{c[0], c[1], c[2], b}, e_d{c[0], c[1], c[2], d};
+                        e_b[b] += half;
+                        e_b[d] += side;
+                        e_d[d] += half;
+                        e_d[b] += side;
+                        edges.push_back(e_b);
+                        edges.push_back(e_d);
+                    }
+            }
+        };
+        Layout cube = [](const Vertex &c, vector<Edge> &edges)
+        {
+            // four edges per axis a
+            for (int64_t a = 0; a < 3; ++a)
+            {
+                int64_t b = (a + 1) % 3, d = (a + 2) % 3;
+                for (int64_t side_b : {-1, 1})
+                    for (int64_t side_d : {-1, 1})
+                        for (int64_t half : {-1, 0})
+                        {
+                            Edge e{c[0], c[1], c[2], a};
+                            e[a] += half;
+                            e[b] += side_b;
+                            e[d] += side_d;
+                            edges.push_back(e);
+                        }
+            }
+        };
+
+        // the layouts are placed around the nearest lattice vertex instead of the
+        // RecPoint itself, so RecPoints close to each other share their HyperLines
+        size_t num = rsis.size();
+        vector<Vertex> centers(num);
+        for (size_t i = 0; i < num; ++i)
+            for (size_t a = 0; a < 3; ++a)
+                centers[i][a] = llround(rsis[i]->rp->pos[a] / offset_space);
+
+        // RecPoints found on each searched edge (with the full search range, since
+        // the edges are shared; addPointsToList selects the near ones)
+        map<Edge, vector<RecPoint>> found;
+        auto searchEdges = [&](vector<Edge> &edges)
+        {
+            sort(edges.begin(), edges.end());
+            edges.erase(unique(edges.begin(), edges.end()), edges.end());
+            edges.erase(remove_if(edges.begin(), edges.end(), [&](const Edge &e)
+                                  { return found.count(e) > 0; }),
+                        edges.end());
+            vector<vector<RecPoint>> results(edges.size());
+#pragma omp parallel for schedule(dynamic)
+            for (size_t e = 0; e < edges.size(); ++e)
+            {
+                Vec3r pA{edges[e][0] * offset_space, edges[e][1] * offset_space, edges[e][2] * offset_space};
+                Vec3r pB = pA;
+                pB[edges[e][3]] = (edges[e][edges[e][3]] + 1) * offset_space;
+                if (!p_flow->isInside(pA) || !p_flow->isInside(pB))
+                    continue;
+                FlowSampler3D sampler(*p_flow);
+                HyperLine hl{pA, pB, &sampler};
+                results[e] = hl.getRecirculationPoints(m_search, false);
+            }
+            for (size_t e = 0; e < edges.size(); ++e)
+                found.emplace(edges[e], move(results[e]));
+        };
+
+        // begin with cross layout, if needed add the points of the cube layout
+        vector<vector<Vec3r>> points(num);
+        vector<size_t> pending(num);
+        for (size_t i = 0; i < num; ++i)
+            pending[i] = i;
+        for (Layout layout : {cross, cube})
+        {
+            vector<Edge> needed;
+            for (size_t i : pending)
+                layout(centers[i], needed);
+            searchEdges(needed);
+#pragma omp parallel for schedule(dynamic)
+            for (size_t p = 0; p < pending.size(); ++p)
+            {
+                size_t i = pending[p];
+                vector<Edge> edges;
+                layout(centers[i], edges);
+                for (const Edge &e : edges)
+                    addPointsToList(found.at(e), rsis[i]->rp.value(), points[i]);
+            }
+            pending.erase(remove_if(pending.begin(), pending.end(), [&](size_t i)
+                                    { return points[i].size() >= 2; }),
+                          pending.end());
+        }
+
+        vector<Vec3r> normals(num, Vec3r{0, 0, 0});
+#pragma omp parallel for schedule(dynamic)
+        for (size_t i = 0; i < num; ++i)
+        {
+            const RecPoint &rp = rsis[i]->rp.value();
+            if (points[i].size() >= 2)
+                normals[i] = normalFromPoints(rp, rsis[i]->ray, points[i]);
+            // still too less points: decrease distance of lines
+            else if (max_steps_smaller > 0)
+                normals[i] = estimateFlowNormal(rp, rsis[i]->ray, offset_space / 2, max_steps_smaller - 1);
+        }
+        return normals;
+    }
+
+    //--------------------------------------------------------------------------//
+    Vec3r RecSurface::normalFromPoints(const RecPoint &rp, const Ray &ray, const vector<Vec3r> &points)
+    {
         Vec3r normal{0, 0, 0};
         // create triangles with the center point and all pairs
         for (size_t i = 0; i < points.size() - 1; ++i)
@@ -253,6 +645,31 @@ namespace RS
         return normal.normalize();
     }
 
+    //--------------------------------------------------------------------------//
+    Vec3r RecSurface::estimateJacobianNormal(const RecPoint &rp, const Ray &ray) const
+    {
+        FlowSampler3D sampler(*p_flow);
+        Vec3r residual;
+        HyperLine::Derivative derivative;
+        if (!HyperLine::evalResidual(sampler, rp.pos, rp.t0, rp.tau, &residual, &derivative))
+            return Vec3r{0, 0, 0};
+
+        // the last two right singular vectors span the null space
+        Eigen::JacobiSVD<HyperLine::Derivative> svd(derivative, Eigen::ComputeFullV);
+        if (svd.singularValues()[2] <= Globals::DETMIN * svd.singularValues()[0])
+            return Vec3r{0, 0, 0};
+        const auto &V = svd.matrixV();
+        Vec3r tangent_a{V(0, 3), V(1, 3), V(2, 3)};
+        Vec3r tangent_b{V(0, 4), V(1, 4), V(2, 4)};
+        Vec3r normal = tangent_a % tangent_b;
+        if (normal.norm() <= Globals::ZERO)
+            return Vec3r{0, 0, 0};
+        // false orientation?
+        if ((ray.direction() | normal) > 0)
+            normal = -normal;
+        return normal.normalize();
+    }
+
     //--------------------------------------------------------------------------//
     void RecSurface::addHyperlineToList(HyperLine &hl,
                                         const RecPoint &rp,
@@ -263,11 +680,18 @@ namespace RS
         Vec3r pB = hl.getHyperPointB().getPos();
         if (!p_flow->isInside(pA) || !p_flow->isInside(pB))
             return;
-        auto found = hl.getRecirculationPoints(sp, false);
+        addPointsToList(hl.getRecirculationPoints(sp, false), rp, points);
+    }
+
+    //--------------------------------------------------------------------------//
+    void RecSurface::addPointsToList(const vector<RecPoint> &found,
+                                     const RecPoint &rp,
+                                     vector<Vec3r> &points)
+    {
         // two conditions for each point to be added:
         // 1. t0 and tau values are near enough
         // 2. there is no point in 3d which is extremely near (check with SPACEEQUAL constant)
-        for (auto &f : found)
+        for (const RecPoint &f : found)
         {
             real dis = (f.pos - rp.pos).norm();
             if (abs(f.t0 - rp.t0) > dis * Globals::NEIGHBOR_DIFT0_PERLU || abs(f.tau - rp.tau) > dis * Globals::NEIGHBOR_DIFTAU_PERLU) // check 1
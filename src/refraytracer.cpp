@@ -1,5 +1,8 @@
 #include "refraytracer.hh"
 
+#include "flowmapcache.hh"
+#include "pixelfrontier.hh"
+#include "progressrecorder.hh"
 #include "timer.hh"
 
 using namespace std;
@@ -106,77 +109,108 @@ namespace RS
     if (checked_domain_rays > 0)
       cout << "Rays saved from last calculation: " << checked_domain_rays << endl;
 
-    omp_lock_t lck;
-    omp_init_lock(&lck);
+    // results are recorded by a single writer thread, so the workers never wait
+    // for progress updates, disk saves or console output
+    auto handle_result = [&](const ProgressRecorder::Record &record)
+    {
+      // save rsi
+      m_progress.update(record.rsi);
+      if (record.domain_intersected)
+        ++checked_domain_rays;
+      if (record.tested)
+      {
+        // save in regular intervals
+        if (checked_domain_rays % 1000 == 0)
+          saveToDisc();
+        cout << "\rFinished: " << checked_domain_rays << " / " << total_domain_rays
+             << " | RecPoints found: " << m_progress.numPointsFound() << flush;
+      }
+    };
+    ProgressRecorder recorder{handle_result};
 
     TimerHandler::reset();
+    size_t start_index = m_progress.getStartIndex();
+    size_t num_tiles = numTiles();
 #pragma omp parallel for schedule(dynamic)
-    for (size_t cam_index = m_progress.getStartIndex(); cam_index < width * height; ++cam_index)
+    for (size_t tile = 0; tile < num_tiles; ++tile)
     {
-      // start overall timer
-      size_t tid = TimerHandler::overall_timer().createTimer();
+      FlowMapCache::TileScope tile_cache;
+      for (size_t cam_index : getTilePixels(tile, start_index))
+      {
+        // start overall timer
+        size_t tid = TimerHandler::overall_timer().createTimer();
 
-      size_t x = cam_index % width, y = cam_index / width;
-      Ray ray = m_cam->ray(x, y);
-      RSIntersection rsi{cam_index, ray, {}, {}};
+        size_t x = cam_index % width, y = cam_index / width;
+        Ray ray = m_cam->ray(x, y);
+        RSIntersection rsi{cam_index, ray, {}, {}};
 
-      bool needs_test, rs_domain_intersected = false;
-      array<color, 2> colors;
+        bool needs_test, rs_domain_intersected = false;
+        array<color, 2> colors;
 
-      // special case: take over value of old raytracer
-      if (canRayBeAdopted(x, y))
-      {
-        needs_test = false;
-        auto old_rsi = m_old_progress.getRSI(x / m_res_increase, y / m_res_increase);
-        if (old_rsi)
+        // special case: take over value of old raytracer
+        if (canRayBeAdopted(x, y))
         {
-          rsi.hit = old_rsi->hit;
-          rsi.rp = old_rsi->rp;
-          colors = {m_scene->t0Color(rsi.rp->t0), m_scene->tauColor(rsi.rp->tau)};
-        }
-        else
-        {
-          color c = m_scene->raytracingCommonObjects(ray);
-          colors = {c, c};
+          needs_test = false;
+          auto old_rsi = m_old_progress.getRSI(x / m_res_increase, y / m_res_increase);
+          if (old_rsi)
+          {
+            rsi.hit = old_rsi->hit;
+            rsi.rp = old_rsi->rp;
+            colors = {m_scene->t0Color(rsi.rp->t0), m_scene->tauColor(rsi.rp->tau)};
+          }
+          else
+          {
+            color c = m_scene->raytracingCommonObjects(ray);
+            colors = {c, c};
+          }
         }
-      }
-      else
-      {
-        // find out start position
-        auto nearest = getNearestIntersection(x, y);
-        needs_test = nearest.has_value();
-
-        if (needs_test)
-          colors = m_scene->raytracing(ray,
-                                       rsi,
-                                       rs_domain_intersected,
-                                       nearest.value() - Globals::RAYBACKOFFSET_REFINEMENT); // set back
         else
         {
-          color c = m_scene->raytracingCommonObjects(ray);
-          colors = {c, c};
+          // find out start position
+          auto nearest = getNearestIntersection(x, y);
+          needs_test = nearest.has_value();
+
+          if (needs_test)
+          {
+            // the (t0, tau) window is taken from the corresponding pixel of the old
+            // raytracer and its neighbours
+            optional<SearchWindow> window;
+            size_t old_x = x / m_res_increase, old_y = y / m_res_increase;
+            for (size_t ny = old_y - 1; ny != old_y + 2; ++ny)
+              for (size_t nx = old_x - 1; nx != old_x + 2; ++nx)
+              {
+                auto old_rsi = m_old_progress.getRSI(nx, ny); // nullptr if outside
+                if (!old_rsi || !old_rsi->rp)
+                  continue;
+                if (window)
+                  window->extend(old_rsi->rp->t0, old_rsi->rp->tau);
+                else
+                  window = SearchWindow(old_rsi->rp->t0, old_rsi->rp->tau);
+              }
+            if (window)
+              window->widen(Globals::RENDER_PRIOR_MARGIN * m_scene->getRecSurface().getSearchParams().dt);
+            colors = m_scene->raytracing(ray,
+                                         rsi,
+                                         rs_domain_intersected,
+                                         nearest.value() - Globals::RAYBACKOFFSET_REFINEMENT, // set back
+                                         numeric_limits<real>::max(),
+                                         window);
+          }
+          else
+          {
+            color c = m_scene->raytracingCommonObjects(ray);
+            colors = {c, c};
+          }
         }
-      }
-      m_texture_t0.pixel(x, y) = colors[0];
-      m_texture_tau.pixel(x, y) = colors[1];
+        m_texture_t0.pixel(x, y) = colors[0];
+        m_texture_tau.pixel(x, y) = colors[1];
 
-      omp_set_lock(&lck);
-      // save rsi
-      m_progress.update(rsi);
-      if (rs_domain_intersected)
-        ++checked_domain_rays;
-      if (needs_test)
-      {
-        // save in regular intervals
-        if (checked_domain_rays % 1000 == 0)
-          saveToDisc();
-        cout << "\rFinished: " << checked_domain_rays << " / " << total_domain_rays
-             << " | RecPoints found: " << m_progress.numPointsFound() << flush;
+        recorder.push({rsi, rs_domain_intersected, needs_test});
+        // end overall timer
+        TimerHandler::overall_timer().deleteTimer(tid);
       }
-      omp_unset_lock(&lck);
-      // end overall timer
-      TimerHandler::overall_timer().deleteTimer(tid);
     }
+    recorder.finish();
     m_progress.saveData();
     m_texture_t0.write_ppm(m_save_dir + "/t0.ppm");
     m_texture_tau.write_ppm(m_save_dir + "/tau.ppm");
@@ -188,119 +222,114 @@ namespace RS
   {
     size_t width = m_cam->plane_width(), height = m_cam->plane_height();
 
-    // 1. Create 2D array containing information about which rays are completely tested (default: false)
-    bool **completely_tested = new bool *[width];
-    for (size_t x = 0; x < width; ++x)
-    {
-      completely_tested[x] = new bool[height];
-      for (size_t y = 0; y < height; ++y)
-      {
-        completely_tested[x][y] = false;
-      }
-    }
+    // 1. Create array containing information about which rays are completely tested (default: false)
+    vector<uint8_t> completely_tested(width * height, 0);
 
-    // 2. Test all points which are on an edge in 5D
-    bool new_test = true;
+    // 2. Test all points which are on an edge in 5D, starting at the neighbors of the
+    // found points and continuing at the neighbors of the new ones
+    PixelFrontier frontier{width, height};
+    frontier.seed([&](size_t cam_index)
+                  { return m_progress.getRSI(cam_index) != nullptr; });
     size_t iteration = 1, rays_tested = 0, new_found = 0, new_found_total = 0, old_total = m_progress.numPointsFound();
-    omp_lock_t lck;
-    omp_init_lock(&lck);
-
-    TimerHandler::reset();
-    while (new_test)
+    // the workers read the progress saver, so new points are collected by the writer
+    // thread and only inserted after each iteration
+    vector<RSIntersection> found_points;
+    auto handle_result = [&](const ProgressRecorder::Record &record)
     {
-      new_test = false;
-      cout << "\rIteration " << iteration << " | RecPoints found: 0 / 0" << flush;
-#pragma omp parallel for schedule(dynamic)
-      for (size_t cam_index = 0; cam_index < width * height; ++cam_index)
+      if (record.domain_intersected)
+        ++rays_tested;
+      if (record.rsi.rp)
       {
-        // start overall timer
-        size_t tid = TimerHandler::overall_timer().createTimer();
-        size_t x = cam_index % width, y = cam_index / width;
+        ++new_found;
+        found_points.push_back(record.rsi);
+      }
+      cout << "\rIteration " << iteration << " | RecPoints found: " << new_found << " / " << rays_tested << flush;
+    };
+    ProgressRecorder *p_recorder = nullptr;
+    auto test_pixel = [&](size_t cam_index)
+    {
+      size_t x = cam_index % width, y = cam_index / width;
 
-        // completely tested rays need no further calculation
-        if (completely_tested[x][y])
-        {
-          TimerHandler::overall_timer().deleteTimer(tid);
-          continue;
-        }
+      // completely tested rays need no further calculation
+      if (completely_tested[cam_index])
+        return false;
 
-        const RSIntersection *rsi = m_progress.getRSI(x, y);
-        // look at all four neighbors of new sampling
-        const RSIntersection *neighbor_RSIs[4] = {
-            m_progress.getRSI(x, y - 1),
-            m_progress.getRSI(x - 1, y),
-            m_progress.getRSI(x, y + 1),
-            m_progress.getRSI(x + 1, y)};
+      const RSIntersection *rsi = m_progress.getRSI(x, y);
+      // look at all four neighbors of new sampling
+      const RSIntersection *neighbor_RSIs[4] = {
+          m_progress.getRSI(x, y - 1),
+          m_progress.getRSI(x - 1, y),
+          m_progress.getRSI(x, y + 1),
+          m_progress.getRSI(x + 1, y)};
 
-        // no neighbors means there is no test needed
-        if (!neighbor_RSIs[0] && !neighbor_RSIs[1] && !neighbor_RSIs[2] && !neighbor_RSIs[3])
-        {
-          TimerHandler::overall_timer().deleteTimer(tid);
-          continue;
-        }
+      // no neighbors means there is no test needed
+      if (!neighbor_RSIs[0] && !neighbor_RSIs[1] && !neighbor_RSIs[2] && !neighbor_RSIs[3])
+        return false;
 
-        // otherwise check case: has own ray an intersection?
-        if (rsi)
+      // otherwise check case: has own ray an intersection?
+      if (rsi)
+      {
+        bool needs_test = false;
+        for (auto neighbor : neighbor_RSIs)
         {
-          bool needs_test = false;
-          for (auto neighbor : neighbor_RSIs)
-          {
-            // is there any neighbor which is nearer to the cam and no 5D neighbor?
-            if (neighbor &&
-                neighbor < rsi &&
-                !rsi->isNeighboring(*neighbor))
-            {
-              // then test!
-              needs_test = true;
-              break;
-            }
-          }
-          // if no such neighbor: no test needed
-          if (!needs_test)
+          // is there any neighbor which is nearer to the cam and no 5D neighbor?
+          if (neighbor &&
+              neighbor < rsi &&
+              !rsi->isNeighboring(*neighbor))
           {
-            TimerHandler::overall_timer().deleteTimer(tid);
-            continue;
+            // then test!
+            needs_test = true;
+            break;
           }
         }
+        // if no such neighbor: no test needed
+        if (!needs_test)
+          return false;
+      }
 
-        // now it is clear that there will be a test
-        completely_tested[x][y] = true;
-
-        Ray ray = m_cam->ray(x, y);
-        RSIntersection test_result{cam_index, ray, {}, {}};
-
-        // search for the position on the ray where the original search began (if there was one)
-        auto nearest = getNearestIntersection(x, y);
-        real old_start = nearest.has_value()
-                             ? nearest.value() - Globals::RAYBACKOFFSET_REFINEMENT
-                             : numeric_limits<real>::max();
-
-        bool rs_domain_intersected = false;
-        array<color, 2> colors = m_scene->raytracing(ray,
-                                                     test_result,
-                                                     rs_domain_intersected,
-                                                     0.0,
-                                                     old_start); // test only up to the found point
-        // if there is a new point: change pixel colors
-        if (test_result.rp)
-        {
-          m_texture_t0.pixel(x, y) = colors[0];
-          m_texture_tau.pixel(x, y) = colors[1];
-        }
+      // now it is clear that there will be a test
+      completely_tested[cam_index] = true;
+      // start overall timer
+      size_t tid = TimerHandler::overall_timer().createTimer();
 
-        omp_set_lock(&lck);
-        if (rs_domain_intersected)
-          ++rays_tested;
-        if (test_result.rp)
-        {
-          ++new_found;
-          m_progress.update(test_result);
-          new_test = true;
-        }
-        cout << "\rIteration " << iteration << " | RecPoints found: " << new_found << " / " << rays_tested << flush;
-        omp_unset_lock(&lck);
-        TimerHandler::overall_timer().deleteTimer(tid);
+      Ray ray = m_cam->ray(x, y);
+      RSIntersection test_result{cam_index, ray, {}, {}};
+
+      // search for the position on the ray where the original search began (if there was one)
+      auto nearest = getNearestIntersection(x, y);
+      real old_start = nearest.has_value()
+                           ? nearest.value() - Globals::RAYBACKOFFSET_REFINEMENT
+                           : numeric_limits<real>::max();
+
+      bool rs_domain_intersected = false;
+      array<color, 2> colors = m_scene->raytracing(ray,
+                                                   test_result,
+                                                   rs_domain_intersected,
+                                                   0.0,
+                                                   old_start); // test only up to the found point
+      // if there is a new point: change pixel colors
+      if (test_result.rp)
+      {
+        m_texture_t0.pixel(x, y) = colors[0];
+        m_texture_tau.pixel(x, y) = colors[1];
       }
+
+      p_recorder->push({test_result, rs_domain_intersected, true});
+      TimerHandler::overall_timer().deleteTimer(tid);
+      return test_result.rp.has_value();
+    };
+
+    TimerHandler::reset();
+    while (!frontier.empty())
+    {
+      cout << "\rIteration " << iteration << " | RecPoints found: 0 / 0" << flush;
+      ProgressRecorder recorder{handle_result};
+      p_recorder = &recorder;
+      frontier.iterate(test_pixel);
+      recorder.finish();
+      for (const RSIntersection &rsi : found_points)
+        m_progress.update(rsi);
+      found_points.clear();
       // save files
       m_progress.saveData();
       m_texture_t0.write_ppm(m_save_dir + "/t0_postpr.ppm");
@@ -315,10 +344,6 @@ namespace RS
     cout << "Total RecPoints found: " << new_found_total
          << " (new: " << dif_new_old
          << ", updated: " << new_found_total - dif_new_old << ")" << endl;
-    // delete created arrays
-    for (size_t x = 0; x < width; ++x)
-      delete[] completely_tested[x];
-    delete[] completely_tested;
   }
   //--------------------------------------------------------------------------//
 }
\ No newline at end of file
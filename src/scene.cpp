@@ -75,7 +75,8 @@ namespace RS
                                       RSIntersection &rsi_result,
                                       bool &rs_domain_intersected,
                                       real begin_at,
-                                      real end_at)
+                                      real end_at,
+                                      const optional<SearchWindow> &window)
     {
         array<color, 2> colors = {m_background, m_background};
 
@@ -91,7 +92,7 @@ namespace RS
         // might not be needed to test the full ray
         end_at = min(end_at, min_t);
 
-        RSIntersection rsi = m_rec_surface.searchIntersection(ray, begin_at, end_at, &rs_domain_intersected);
+        RSIntersection rsi = m_rec_surface.searchIntersection(ray, begin_at, end_at, &rs_domain_intersected, window);
         if (rsi.rp.has_value())
         {
             rsi_result.rp = rsi.rp;
@@ -1,8 +1,11 @@
 #include "shader.hh"
 
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <omp.h>
 
+#include "pixelfrontier.hh"
 #include "ray.hh"
 #include "scene.hh"
 #include "timer.hh"
@@ -103,6 +106,7 @@ namespace RS
         }
         const ProgressSaver &progress = m_raytracer->getProgress();
         size_t num_finished = 0, num_successfull = 0;
+        vector<size_t> sampled; // pixels which need the sampling of further HyperLines
         // start parallel execution
         omp_lock_t lck{};
         omp_init_lock(&lck);
@@ -113,7 +117,7 @@ namespace RS
             // start overall timer
             size_t tid = TimerHandler::overall_timer().createTimer();
 
-            bool success = false;
+            bool success = false, sample = false;
             m_normals[cam_index] = Vec3r(0, 0, 0);
 
             // check if there was a RSI / RecPoint found
@@ -132,16 +136,18 @@ namespace RS
                 // SAMPLING or HYBRID and test is needed
                 if (strategy != NEIGHBORS && !success)
                 {
-                    n = m_raytracer->getScene()->getRecSurface().estimateFlowNormal(
-                        rsi->rp.value(),
-                        rsi->ray,
-                        Globals::NORMAL_SEARCHDIS,
-                        Globals::NORMAL_MAXSTEPS);
+                    const RecSurface &rs = m_raytracer->getScene()->getRecSurface();
+                    // the Jacobian of the flow map needs a single integration, the
+                    // sampling of further HyperLines is only done if it is degenerated
+                    n = rs.estimateJacobianNormal(rsi->rp.value(), rsi->ray);
                     success = n[0] != 0 || n[1] != 0 || n[2] != 0;
+                    sample = !success;
                 }
                 omp_set_lock(&lck);
                 if (success)
                     ++num_successfull;
+                if (sample)
+                    sampled.push_back(cam_index);
                 if (strategy != NEIGHBORS)
                     cout << "\rFinished: " << ++num_finished << " / " << progress.numPointsFound() << flush;
                 omp_unset_lock(&lck);
@@ -149,6 +155,29 @@ namespace RS
             // close overall timer
             TimerHandler::overall_timer().deleteTimer(tid);
         }
+        // the sampling of further HyperLines is done for all remaining RecPoints at
+        // once, so neighboring RecPoints share their HyperLines
+        if (!sampled.empty())
+        {
+            cout << "\r\33[KSampling normals: " << sampled.size() << " / " << progress.numPointsFound() << flush;
+            sort(sampled.begin(), sampled.end());
+            vector<const RSIntersection *> rsis;
+            for (size_t cam_index : sampled)
+                rsis.push_back(progress.getRSI(cam_index));
+            size_t tid = TimerHandler::overall_timer().createTimer();
+            vector<Vec3r> normals = m_raytracer->getScene()->getRecSurface().estimateFlowNormals(
+                rsis,
+                Globals::NORMAL_SEARCHDIS,
+                Globals::NORMAL_MAXSTEPS);
+            TimerHandler::overall_timer().deleteTimer(tid);
+            for (size_t i = 0; i < sampled.size(); ++i)
+            {
+                const Vec3r &n = normals[i];
+                m_normals[sampled[i]] = n;
+                if (n[0] != 0 || n[1] != 0 || n[2] != 0)
+                    ++num_successfull;
+            }
+        }
         cout << "\r\33[KTotal normals found: " << num_successfull << " / " << progress.numPointsFound() << endl;
         // set overview values
         m_is_normals_ready = true;
@@ -166,6 +195,18 @@ namespace RS
             return;
         }
 
+        // the shadows of the RecSurface are looked up in a depth map seen from the light
+        if (Globals::SHADOWMAP_RESOLUTION > 0 && !m_shadow_map)
+        {
+            string shadow_map_dir = m_save_dir + "/shadowmap";
+            filesystem::create_directories(shadow_map_dir);
+            m_shadow_map = make_unique<ShadowMap>(m_raytracer->getScene(),
+                                                  m_light.light_direction_to(Vec3r{0, 0, 0}),
+                                                  Globals::SHADOWMAP_RESOLUTION,
+                                                  shadow_map_dir + "/");
+            m_shadow_map->render();
+        }
+
         const ProgressSaver &progress = m_raytracer->getProgress();
         // find out how many tests are needed for better output
         size_t num_total_tests = 0;
@@ -174,7 +215,7 @@ namespace RS
                 if (progress.getRSI(x, y) ||
                     m_raytracer->getScene()->getCommonObjectIntersection(m_raytracer->getCamera()->ray(x, y)))
                     ++num_total_tests;
-        size_t num_tested = 0, num_found = 0;
+        size_t num_tested = 0, num_found = 0, num_light_rays = 0;
 
         // start parallel execution
         omp_lock_t lck{};
@@ -202,11 +243,14 @@ namespace RS
             // set value
             if (pos.has_value())
             {
-                bool result = isInShadow(pos.value());
+                bool needed_light_ray = false;
+                bool result = isInShadow(pos.value(), &needed_light_ray);
                 m_in_shadow[cam_index] = result;
                 omp_set_lock(&lck);
                 if (result)
                     ++num_found;
+                if (needed_light_ray)
+                    ++num_light_rays;
                 cout << "\rFinished: " << ++num_tested << " / " << num_total_tests
                      << " | Shadows found: " << num_found << flush;
                 omp_unset_lock(&lck);
@@ -217,6 +261,8 @@ namespace RS
             TimerHandler::overall_timer().deleteTimer(tid);
         }
         cout << "\r\33[KTotal shadows found: " << num_found << " / " << num_total_tests << endl;
+        if (m_shadow_map)
+            cout << "Searched light rays: " << num_light_rays << " / " << num_total_tests << endl;
         m_is_shadows_ready = true;
         saveShadows();
     }
@@ -235,100 +281,84 @@ namespace RS
             return;
         }
         // save which light rays have already been tested completely (default: false)
-        bool **completely_tested = new bool *[m_cam_width];
-        for (size_t x = 0; x < m_cam_width; ++x)
-        {
-            completely_tested[x] = new bool[m_cam_height];
-            for (size_t y = 0; y < m_cam_height; ++y)
-                completely_tested[x][y] = false;
-        }
+        vector<uint8_t> completely_tested(m_cam_width * m_cam_height, 0);
+        // only pixels next to a shadow can change: start at the pixels in shadow and
+        // continue at the new ones
+        PixelFrontier frontier{m_cam_width, m_cam_height};
+        frontier.seed([&](size_t cam_index)
+                      { return bool(m_in_shadow[cam_index]); });
 
-        bool new_test = true;
         size_t iteration = 1, num_tested = 0, num_found = 0, num_found_total = 0;
         omp_lock_t lck;
         omp_init_lock(&lck);
         TimerHandler::reset();
-        while (new_test)
+        // each iteration only reads the shadows of the previous one, the new shadows
+        // are written after it, so the result does not depend on the order of the threads
+        auto test_pixel = [&](size_t cam_index)
         {
-            cout << "\rIteration " << iteration << " | Shadows found: 0 / 0" << flush;
-            new_test = false;
-#pragma omp parallel for schedule(dynamic)
-            for (size_t cam_index = 0; cam_index < m_cam_width * m_cam_height; ++cam_index)
+            size_t x = cam_index % m_cam_width, y = cam_index / m_cam_width;
+            // skip if it is in shadow itself
+            if (m_in_shadow[cam_index] || completely_tested[cam_index])
+                return false;
+            // check each neighbor if it is in shadow
+            bool test = (x > 0 && m_in_shadow[cam_index - 1]) ||
+                        (x < m_cam_width - 1 && m_in_shadow[cam_index + 1]) ||
+                        (y > 0 && m_in_shadow[cam_index - m_cam_width]) ||
+                        (y < m_cam_height - 1 && m_in_shadow[cam_index + m_cam_width]);
+            if (!test)
+                return false;
+            // find out position
+            Vec3r pos;
+            // might be from RecSurface...
+            const RSIntersection *temp_rsi = m_raytracer->getProgress().getRSI(x, y);
+            if (temp_rsi)
+                pos = temp_rsi->rp->pos;
+            // ... or from a common object
+            else
             {
-                size_t tid = TimerHandler::overall_timer().createTimer();
-
-                size_t x = cam_index % m_cam_width, y = cam_index / m_cam_width;
-                // skip if it is in shadow itself
-                if (m_in_shadow[cam_index] || completely_tested[x][y])
-                {
-                    TimerHandler::overall_timer().deleteTimer(tid);
-                    continue;
-                }
-                // check each neighbor if it is in shadow
-                bool test = (x > 0 && m_in_shadow[cam_index - 1]) ||
-                            (x < m_cam_width - 1 && m_in_shadow[cam_index + 1]) ||
-                            (y > 0 && m_in_shadow[cam_index - m_cam_width]) ||
-                            (y < m_cam_height - 1 && m_in_shadow[cam_index + m_cam_height]);
-                if (!test)
-                {
-                    TimerHandler::overall_timer().deleteTimer(tid);
-                    continue;
-                }
-                // find out position
-                Vec3r pos;
-                // might be from RecSurface...
-                const RSIntersection *temp_rsi = m_raytracer->getProgress().getRSI(x, y);
-                if (temp_rsi)
-                    pos = temp_rsi->rp->pos;
-                // ... or from a common object
-                else
-                {
-                    auto opt = m_raytracer->getScene()->getCommonObjectIntersection(
-                        m_raytracer->getCamera()->ray(x, y));
-                    // if neither the one thing nor the other: skip
-                    if (!opt)
-                    {
-                        TimerHandler::overall_timer().deleteTimer(tid);
-                        continue;
-                    }
-                    pos = opt->position;
-                }
-                // common objects don't need to be retested since they were completely tested
-                Ray light_ray{pos, -m_light.light_direction_to(pos)};
-                // now test the parts of the light ray not tested before
-                RSIntersection rsi = m_raytracer->getScene()->getRecSurface().searchIntersection(
-                    light_ray,
-                    m_raytracer->getProgress(),
-                    *(m_raytracer->getCamera()),
-                    m_raytracer->getScene()->getObjects(),
-                    Globals::RAYFOREOFFSET_SHADOWS, // sets start pos on ray -> no self intersection
-                    numeric_limits<real>::max(),    // default
-                    nullptr,                        // default / unnessesary
-                    true);                          // sets inverted search
-                m_in_shadow[cam_index] = rsi.rp.has_value();
-
-                completely_tested[x][y] = true;
-
-                omp_set_lock(&lck);
-                if (rsi.rp.has_value())
-                {
-                    ++num_found;
-                    new_test = true;
-                }
-                cout << "\rIteration " << iteration << " | Shadows found: " << num_found << " / " << ++num_tested << flush;
-                omp_unset_lock(&lck);
-                TimerHandler::overall_timer().deleteTimer(tid);
+                auto opt = m_raytracer->getScene()->getCommonObjectIntersection(
+                    m_raytracer->getCamera()->ray(x, y));
+                // if neither the one thing nor the other: skip
+                if (!opt)
+                    return false;
+                pos = opt->position;
             }
+            size_t tid = TimerHandler::overall_timer().createTimer();
+            // common objects don't need to be retested since they were completely tested
+            Ray light_ray{pos, -m_light.light_direction_to(pos)};
+            // now test the parts of the light ray not tested before
+            RSIntersection rsi = m_raytracer->getScene()->getRecSurface().searchIntersection(
+                light_ray,
+                m_raytracer->getProgress(),
+                *(m_raytracer->getCamera()),
+                m_raytracer->getScene()->getObjects(),
+                Globals::RAYFOREOFFSET_SHADOWS, // sets start pos on ray -> no self intersection
+                numeric_limits<real>::max(),    // default
+                nullptr,                        // default / unnessesary
+                true);                          // sets inverted search
+
+            completely_tested[cam_index] = true;
+
+            omp_set_lock(&lck);
+            if (rsi.rp.has_value())
+                ++num_found;
+            cout << "\rIteration " << iteration << " | Shadows found: " << num_found << " / " << ++num_tested << flush;
+            omp_unset_lock(&lck);
+            TimerHandler::overall_timer().deleteTimer(tid);
+            return rsi.rp.has_value();
+        };
+        while (!frontier.empty())
+        {
+            cout << "\rIteration " << iteration << " | Shadows found: 0 / 0" << flush;
+            frontier.iterate(test_pixel);
+            for (size_t cam_index : frontier.changed())
+                m_in_shadow[cam_index] = true;
             ++iteration;
             num_found_total += num_found;
             num_tested = num_found = 0;
             cout << endl;
         }
         cout << "Total shadows found: " << num_found_total << endl;
-        // delete used arrays
-        for (size_t x = 0; x < m_cam_width; ++x)
-            delete[] completely_tested[x];
-        delete[] completely_tested;
 
         m_is_shadows_sharp = true;
         saveShadows();
@@ -470,9 +500,11 @@ namespace RS
     }
 
     // ------------------------------------------------------------------------- //
-    bool Shader::isInShadow(const Vec3r &point) const
+    bool Shader::isInShadow(const Vec3r &point, bool *needed_light_ray) const
     {
         Ray light_ray{point, -m_light.light_direction_to(point)};
+        if (needed_light_ray)
+            *needed_light_ray = false;
 
         // First: test all simple objects
         auto &objects = m_raytracer->getScene()->getObjects();
@@ -480,7 +512,15 @@ namespace RS
             if (obj->getIntersection(light_ray, Globals::SMALL).has_value())
                 return true;
 
-        // Second: check the RecSurface
+        // Second: check the RecSurface, the shadow map is only ambiguous near its edges
+        if (m_shadow_map)
+        {
+            optional<bool> in_shadow = m_shadow_map->isInShadow(point);
+            if (in_shadow.has_value())
+                return in_shadow.value();
+        }
+        if (needed_light_ray)
+            *needed_light_ray = true;
         RSIntersection rsi = m_raytracer->getScene()->getRecSurface().searchIntersection(
             light_ray,
             m_raytracer->getProgress(),
@@ -0,0 +1,104 @@
+#include "shadowmap.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+// ------------------------------------------------------------------------- //
+namespace RS
+{
+    // ------------------------------------------------------------------------- //
+    /// Creates the camera of the light: it looks along light_dir at the center of
+    /// the domain from outside of it and its image plane covers the domain.
+    static shared_ptr<OrthographicCamera> createLightCamera(const Vec3r &light_dir,
+                                                            const AABB &domain,
+                                                            size_t resolution)
+    {
+        Vec3r dir = light_dir;
+        dir.normalize();
+        // the up axis is the one which is least aligned with the light
+        Vec3r up{0, 0, 0};
+        size_t least = 0;
+        for (size_t i = 1; i < 3; ++i)
+            if (abs(dir[i]) < abs(dir[least]))
+                least = i;
+        up[least] = 1;
+        // axes of the image plane (see OrthographicCamera)
+        Vec3r u = (up % (-dir)).normalize();
+        Vec3r v = (-dir) % u;
+
+        const Vec3r &lo = domain.getMin(), &hi = domain.getMax();
+        Vec3r center = (lo + hi) * 0.5;
+        real half_u = 0, half_v = 0;
+        for (size_t c = 0; c < 8; ++c)
+        {
+            Vec3r corner{c & 1 ? hi[0] : lo[0], c & 2 ? hi[1] : lo[1], c & 4 ? hi[2] : lo[2]};
+            half_u = max(half_u, abs((corner - center) | u));
+            half_v = max(half_v, abs((corner - center) | v));
+        }
+        // the rays start at the lower left corners of the texels, one more covers the domain
+        real texel = 2 * max(half_u, half_v) / max(resolution, size_t(1));
+        size_t res_x = size_t(ceil(2 * half_u / texel)) + 1;
+        size_t res_y = size_t(ceil(2 * half_v / texel)) + 1;
+        Vec3r eye = center - dir * ((hi - lo).norm() + 1);
+        return make_shared<OrthographicCamera>(eye, center, res_x * texel, res_x, res_y, up);
+    }
+
+    // ------------------------------------------------------------------------- //
+    ShadowMap::ShadowMap(shared_ptr<Scene> scene,
+                         const Vec3r &light_dir,
+                         size_t resolution,
+                         const string &save_dir)
+        : m_cam{createLightCamera(light_dir, scene->getRecSurface().getDataParams().domain, resolution)},
+          m_raytracer{make_unique<Raytracer>(m_cam, scene, save_dir)},
+          // the RecPoints are only found up to the step size on the ray
+          m_bias{Globals::RAYFOREOFFSET_SHADOWS + scene->getRecSurface().getDataParams().step_size},
+          m_depths{}
+    {
+    }
+
+    // ------------------------------------------------------------------------- //
+    void ShadowMap::render()
+    {
+        m_raytracer->render();
+
+        size_t width = m_cam->plane_width(), height = m_cam->plane_height();
+        const ProgressSaver &progress = m_raytracer->getProgress();
+        m_depths.assign(width * height, numeric_limits<real>::infinity());
+        for (size_t y = 0; y < height; ++y)
+            for (size_t x = 0; x < width; ++x)
+                if (const RSIntersection *rsi = progress.getRSI(x, y))
+                    m_depths[y * width + x] = m_cam->depth(rsi->rp->pos);
+    }
+
+    // ------------------------------------------------------------------------- //
+    optional<bool> ShadowMap::isInShadow(const Vec3r &pos) const
+    {
+        // texel with the nearest ray
+        Vec2r canvas = m_cam->projection(pos);
+        long cx = lround(canvas[0]), cy = lround(canvas[1]);
+        long radius = long(Globals::SHADOWMAP_PCFRADIUS);
+        long width = long(m_cam->plane_width()), height = long(m_cam->plane_height());
+
+        // texels outside of the map do not contain RecPoints
+        real limit = m_cam->depth(pos) - m_bias;
+        size_t num_texels = 0, num_shadowing = 0;
+        for (long y = cy - radius; y <= cy + radius; ++y)
+            for (long x = cx - radius; x <= cx + radius; ++x)
+            {
+                ++num_texels;
+                if (x >= 0 && y >= 0 && x < width && y < height && !m_depths.empty() &&
+                    m_depths[y * width + x] < limit)
+                    ++num_shadowing;
+            }
+        if (0 == num_shadowing)
+            return false;
+        if (num_texels == num_shadowing)
+            return true;
+        return {};
+    }
+    // ------------------------------------------------------------------------- //
+}
+// ------------------------------------------------------------------------- //
@@ -0,0 +1,144 @@
+#include "slicestream.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace std;
+
+//--------------------------------------------------------------------------//
+namespace RS
+{
+  //--------------------------------------------------------------------------//
+  SliceStream::SliceStream(const std::string &filename,
+                           size_t offset,
+                           size_t sliceSize,
+                           int numSlices,
+                           size_t maxResident,
+                           int prefetch)
+      : m_offset(offset), m_sliceSize(sliceSize), m_numSlices(numSlices),
+        m_maxResident(max(maxResident, size_t(2))),
+        m_prefetch(min(prefetch, int(m_maxResident) - 2))
+  {
+    m_fd = open(filename.c_str(), O_RDONLY);
+    if (m_fd >= 0 && m_prefetch > 0)
+      m_thread = thread(&SliceStream::prefetchLoop, this);
+  }
+
+  //--------------------------------------------------------------------------//
+  SliceStream::~SliceStream(void)
+  {
+    {
+      lock_guard<mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_condition.notify_all();
+    if (m_thread.joinable())
+      m_thread.join();
+    if (m_fd >= 0)
+      close(m_fd);
+  }
+
+  //--------------------------------------------------------------------------//
+  SliceStream::Slice SliceStream::getSlice(int index, int direction)
+  {
+    Slice slice;
+    {
+      lock_guard<mutex> lock(m_mutex);
+      auto it = m_slices.find(index);
+      if (it != m_slices.end())
+      {
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru_pos);
+        slice = it->second.data;
+      }
+      // request the following slices in the direction of the access
+      int step = direction < 0 ? -1 : 1;
+      for (int k = 1; k <= m_prefetch; ++k)
+      {
+        int i = index + k * step;
+        if (i < 0 || i >= m_numSlices)
+          break;
+        if (m_slices.find(i) == m_slices.end() &&
+            find(m_requests.begin(), m_requests.end(), i) == m_requests.end())
+          m_requests.push_back(i);
+      }
+    }
+    m_condition.notify_one();
+    if (slice)
+      return slice;
+
+    // read it without holding the lock (it might be read twice, if the
+    // prefetcher is working on the same slice)
+    slice = readSlice(index);
+    if (!slice)
+      throw runtime_error("Could not read slice " + to_string(index) + " of the streamed grid: " +
+                          (errno ? strerror(errno) : "file too short"));
+    lock_guard<mutex> lock(m_mutex);
+    return insert(index, slice);
+  }
+
+  //--------------------------------------------------------------------------//
+  SliceStream::Slice SliceStream::readSlice(int index) const
+  {
+    auto data = make_shared<vector<float>>(m_sliceSize);
+    size_t bytes = m_sliceSize * sizeof(float);
+    off_t position = m_offset + size_t(index) * bytes;
+    size_t done = 0;
+    errno = 0;
+    while (done < bytes)
+    {
+      ssize_t n = pread(m_fd, reinterpret_cast<char *>(data->data()) + done, bytes - done, position + done);
+      if (n < 0 && EINTR == errno)
+        continue;
+      // a short read would leave zero velocities in the slice
+      if (n <= 0)
+        return nullptr;
+      done += n;
+    }
+    return data;
+  }
+
+  //--------------------------------------------------------------------------//
+  SliceStream::Slice SliceStream::insert(int index, const Slice &slice)
+  {
+    auto it = m_slices.find(index);
+    if (it != m_slices.end())
+      return it->second.data;
+    m_lru.push_front(index);
+    m_slices[index] = Entry{slice, m_lru.begin()};
+    while (m_slices.size() > m_maxResident)
+    {
+      m_slices.erase(m_lru.back());
+      m_lru.pop_back();
+    }
+    return slice;
+  }
+
+  //--------------------------------------------------------------------------//
+  void SliceStream::prefetchLoop(void)
+  {
+    unique_lock<mutex> lock(m_mutex);
+    while (true)
+    {
+      m_condition.wait(lock, [this] { return m_stop || !m_requests.empty(); });
+      if (m_stop)
+        return;
+      int index = m_requests.front();
+      m_requests.pop_front();
+      if (m_slices.find(index) != m_slices.end())
+        continue;
+
+      lock.unlock();
+      Slice slice = readSlice(index);
+      lock.lock();
+      // failed reads are reported when the slice is requested
+      if (slice)
+        insert(index, slice);
+    }
+  }
+  //--------------------------------------------------------------------------//
+}
+//--------------------------------------------------------------------------//